@@ -4,13 +4,15 @@
 #include <limits.h>
 //for seeding random number generator
 #include <sys/time.h>
+//for generating key characters
+#include "otp.h"
 
 //minimum and maximum values for key length
 #define KEY_LENGTH_MIN 1
 #define KEY_LENGTH_MAX INT_MAX
 
-//key base is 27, because there are 27 different characters (which means digits should be between 0-26)
-#define KEY_BASE 27
+//number of key characters generated before they are output
+#define KEY_OUTPUT_BUFFER_SIZE 65536
 
 
 //print program usage
@@ -27,26 +29,6 @@ int isValidKeyLength(int keyLength){
 	return keyLength >= KEY_LENGTH_MIN && keyLength <= KEY_LENGTH_MAX;
 }
 
-//returns a random integer using key base
-//based on: https://www.tutorialspoint.com/c_standard_library/c_function_rand.htm
-int getRandInt(){
-	return rand() % KEY_BASE;
-}
-
-//converts random integer to a character
-//random numbers are 0-26 (because base is 27, that means 26 should be the highest number)
-//function returns character either A-Z (capital) or space char
-char randIntToChar(int num){
-	//highest number, or numbers out of range return ' ' (space character)
-	if(num >= 26 || num < 0){
-		return ' ';
-	}
-	//uppercase A is ASCII char 65
-	int offset = 65;
-	return num + offset;
-}
-
-
 //initialize random number generator
 //based on: http://stackoverflow.com/questions/322938/recommended-way-to-initialize-srand
 //seed will only repeat once every 24 days
@@ -60,10 +42,14 @@ void seedRandom(){
 
 //output sequence random characters (A-Z and spaces) for the length of keyLength
 //followed by newline at the end
+//key is generated in blocks, so that output is written all at once instead of a character at a time
 void printRandomKey(int keyLength){
-	int i;
-	for(i = 0; i < keyLength; ++i){
-		printf("%c", randIntToChar(getRandInt()));
+	char keyBuffer[KEY_OUTPUT_BUFFER_SIZE];
+	while(keyLength > 0){
+		int blockLength = keyLength < KEY_OUTPUT_BUFFER_SIZE ? keyLength : KEY_OUTPUT_BUFFER_SIZE;
+		otpGenerateKey(keyBuffer, blockLength);
+		fwrite(keyBuffer, sizeof(char), blockLength, stdout);
+		keyLength -= blockLength;
 	}
 
 	//last char output must be newline
@@ -0,0 +1,337 @@
+/*
+ * One time pad library
+ * character encoding/decoding functions used by servers, clients and keygen
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+//for transforming segments of long messages at the same time
+#include <pthread.h>
+
+#include "otp.h"
+
+//normalizes ASCII A-Z and space to int from
+//0-26 (base 27), with 0 being A and 26 being space
+//returns -1 if character is not A-Z or space
+int otpCharToBase27(char c){
+  //check for space character
+  if(c == ' '){
+    return 26;
+  }
+  //A is ASCII character 65
+  if(c >= 'A' && c <= 'Z'){
+    return c - 'A';
+  }
+  return -1;
+}
+
+//reverse of otpCharToBase27
+//converts base 27 number to ASCII char
+//A-Z or space (26 is space char, 0 is A)
+//numbers out of range also return space
+char otpBase27ToChar(int d){
+  if(d >= 26 || d < 0){
+    return ' ';
+  }
+  return d + 'A';
+}
+
+//returns 1 (true) if the first length characters of text are only A-Z or space, otherwise 0 (false)
+int otpIsValidText(const char *text, size_t length){
+  size_t i;
+  for(i = 0; i < length; ++i){
+    if(otpCharToBase27(text[i]) < 0){
+      return 0;
+    }
+  }
+  return 1;
+}
+
+//encodes message with key, by adding base 27 versions of characters together
+//and keeping result in base 27
+//returns 0 on success or -1 if message or key contain invalid characters
+int otpEncode(const char *message, const char *key, char *output, size_t length){
+  size_t i;
+  for(i = 0; i < length; ++i){
+    int base27MessageChar = otpCharToBase27(message[i]);
+    int base27KeyChar = otpCharToBase27(key[i]);
+    if(base27MessageChar < 0 || base27KeyChar < 0){
+      return -1;
+    }
+    //sum is at most 52, so subtracting once is the same as % 27
+    int sum = base27MessageChar + base27KeyChar;
+    output[i] = otpBase27ToChar(sum >= OTP_BASE ? sum - OTP_BASE : sum);
+  }
+  return 0;
+}
+
+//decodes message with key, by subtracting key from encoded message
+//and keeping result in base 27
+//returns 0 on success or -1 if message or key contain invalid characters
+int otpDecode(const char *message, const char *key, char *output, size_t length){
+  size_t i;
+  for(i = 0; i < length; ++i){
+    int base27MessageChar = otpCharToBase27(message[i]);
+    int base27KeyChar = otpCharToBase27(key[i]);
+    if(base27MessageChar < 0 || base27KeyChar < 0){
+      return -1;
+    }
+    //difference is at least -26, so adding the base once is enough to make it positive
+    int difference = base27MessageChar - base27KeyChar;
+    output[i] = otpBase27ToChar(difference < 0 ? difference + OTP_BASE : difference);
+  }
+  return 0;
+}
+
+//exclusive or is done on this many bytes at a time
+//compiler uses the widest vector instructions the target supports (e.g. 2 SSE2 or 1 AVX2 instruction)
+typedef unsigned char OtpXorVector __attribute__((vector_size(32)));
+
+//combines length bytes of message with key using exclusive or and stores result in output
+//always returns 0, so it can be used as an OtpTransformFunction
+int otpXor(const char *message, const char *key, char *output, size_t length){
+  size_t i = 0;
+  //4 vectors at a time, so loads of the next vector don't wait on the previous store
+  //memcpy is used for loads and stores, since buffers aren't necessarily aligned
+  for(; i + 4 * sizeof(OtpXorVector) <= length; i += 4 * sizeof(OtpXorVector)){
+    OtpXorVector messageVectors[4];
+    OtpXorVector keyVectors[4];
+    memcpy(messageVectors, message + i, sizeof(messageVectors));
+    memcpy(keyVectors, key + i, sizeof(keyVectors));
+    messageVectors[0] ^= keyVectors[0];
+    messageVectors[1] ^= keyVectors[1];
+    messageVectors[2] ^= keyVectors[2];
+    messageVectors[3] ^= keyVectors[3];
+    memcpy(output + i, messageVectors, sizeof(messageVectors));
+  }
+  for(; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)){
+    uint64_t messageWord;
+    uint64_t keyWord;
+    memcpy(&messageWord, message + i, sizeof(messageWord));
+    memcpy(&keyWord, key + i, sizeof(keyWord));
+    messageWord ^= keyWord;
+    memcpy(output + i, &messageWord, sizeof(messageWord));
+  }
+  for(; i < length; ++i){
+    output[i] = message[i] ^ key[i];
+  }
+  return 0;
+}
+
+//part of message transformed by one thread in otpTransformParallel
+typedef struct OtpSegment{
+  OtpTransformFunction transformFunction;
+  const char *message;
+  const char *key;
+  char *output;
+  size_t length;
+  //result of transform function
+  int result;
+} OtpSegment;
+
+//transforms one segment and stores its result
+static void transformSegment(OtpSegment *segment){
+  segment->result = segment->transformFunction(segment->message, segment->key, segment->output, segment->length);
+}
+
+struct OtpWorkerPool{
+  pthread_mutex_t mutex;
+  //signalled when there are new segments, or pool is being destroyed
+  pthread_cond_t workReady;
+  //signalled when the last worker finishes its segment
+  pthread_cond_t workDone;
+  //worker threads, which transform segments 1 to threadCount - 1
+  pthread_t *threads;
+  //number of threads transforming segments, including the one calling otpWorkerPoolTransform
+  int threadCount;
+  OtpSegment *segments;
+  //number of segments in the current transform
+  int segmentCount;
+  //number of worker threads that haven't finished their segment of the current transform
+  int unfinishedCount;
+  //increased for each transform, so workers can tell new work from a spurious wakeup
+  unsigned long generation;
+  int isStopping;
+};
+
+//passed to each worker thread when it starts
+typedef struct OtpWorker{
+  OtpWorkerPool *pool;
+  int segmentIndex;
+} OtpWorker;
+
+//thread start function for worker threads
+//waits for each new transform, and transforms its segment if the transform has one for it
+static void * runWorker(void *argument){
+  OtpWorker *worker = argument;
+  OtpWorkerPool *pool = worker->pool;
+  int segmentIndex = worker->segmentIndex;
+  free(worker);
+  unsigned long generation = 0;
+  pthread_mutex_lock(&pool->mutex);
+  while(1){
+    while(pool->generation == generation && !pool->isStopping){
+      pthread_cond_wait(&pool->workReady, &pool->mutex);
+    }
+    if(pool->isStopping){
+      break;
+    }
+    generation = pool->generation;
+    if(segmentIndex >= pool->segmentCount){
+      continue;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    transformSegment(&pool->segments[segmentIndex]);
+    pthread_mutex_lock(&pool->mutex);
+    if(--pool->unfinishedCount == 0){
+      pthread_cond_signal(&pool->workDone);
+    }
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+//starts threadCount - 1 threads, since the thread calling otpWorkerPoolTransform transforms one segment itself
+//returns NULL if pool can't be created
+OtpWorkerPool * otpWorkerPoolCreate(int threadCount){
+  if(threadCount < 1){
+    threadCount = 1;
+  }
+  OtpWorkerPool *pool = calloc(1, sizeof(OtpWorkerPool));
+  if(pool == NULL){
+    return NULL;
+  }
+  pool->threads = malloc(sizeof(pthread_t) * threadCount);
+  pool->segments = calloc(threadCount, sizeof(OtpSegment));
+  if(pool->threads == NULL || pool->segments == NULL){
+    free(pool->threads);
+    free(pool->segments);
+    free(pool);
+    return NULL;
+  }
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->workReady, NULL);
+  pthread_cond_init(&pool->workDone, NULL);
+  //segment 0 belongs to the calling thread
+  pool->threadCount = 1;
+  while(pool->threadCount < threadCount){
+    OtpWorker *worker = malloc(sizeof(OtpWorker));
+    if(worker == NULL){
+      break;
+    }
+    worker->pool = pool;
+    worker->segmentIndex = pool->threadCount;
+    if(pthread_create(&pool->threads[pool->threadCount], NULL, runWorker, worker) != 0){
+      free(worker);
+      break;
+    }
+    pool->threadCount++;
+  }
+  return pool;
+}
+
+//splits message and key into segments that are transformed at the same time by the pool's threads
+//one time pad is applied character by character, so each segment can be transformed independently
+//returns 0 on success or -1 if message or key contain invalid characters
+int otpWorkerPoolTransform(OtpWorkerPool *pool, OtpTransformFunction transformFunction, const char *message, const char *key, char *output, size_t length){
+  //don't use more threads than there are minimum length segments
+  size_t segmentCount = length / OTP_MIN_SEGMENT_LENGTH;
+  if(segmentCount > (size_t)pool->threadCount){
+    segmentCount = pool->threadCount;
+  }
+  if(segmentCount <= 1){
+    return transformFunction(message, key, output, length);
+  }
+  //round segment length up to alignment, so last segment is the shortest
+  size_t segmentLength = (length + segmentCount - 1) / segmentCount;
+  segmentLength = (segmentLength + OTP_SEGMENT_ALIGNMENT - 1) / OTP_SEGMENT_ALIGNMENT * OTP_SEGMENT_ALIGNMENT;
+
+  //rounding up can leave nothing for the last segments, so only segments with characters are counted
+  size_t offset = 0;
+  int usedSegmentCount = 0;
+  while(usedSegmentCount < (int)segmentCount && offset < length){
+    OtpSegment *segment = &pool->segments[usedSegmentCount++];
+    segment->transformFunction = transformFunction;
+    segment->message = message + offset;
+    segment->key = key + offset;
+    segment->output = output + offset;
+    segment->length = length - offset < segmentLength ? length - offset : segmentLength;
+    segment->result = -1;
+    offset += segment->length;
+  }
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->segmentCount = usedSegmentCount;
+  pool->unfinishedCount = usedSegmentCount - 1;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->workReady);
+  pthread_mutex_unlock(&pool->mutex);
+
+  //calling thread transforms the first segment while the workers transform the others
+  transformSegment(&pool->segments[0]);
+
+  pthread_mutex_lock(&pool->mutex);
+  while(pool->unfinishedCount > 0){
+    pthread_cond_wait(&pool->workDone, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  int returnValue = 0;
+  int i;
+  for(i = 0; i < usedSegmentCount; ++i){
+    returnValue |= pool->segments[i].result;
+  }
+  return returnValue == 0 ? 0 : -1;
+}
+
+//stops pool's threads and frees pool
+void otpWorkerPoolDestroy(OtpWorkerPool *pool){
+  if(pool == NULL){
+    return;
+  }
+  pthread_mutex_lock(&pool->mutex);
+  pool->isStopping = 1;
+  pthread_cond_broadcast(&pool->workReady);
+  pthread_mutex_unlock(&pool->mutex);
+  int i;
+  for(i = 1; i < pool->threadCount; ++i){
+    pthread_join(pool->threads[i], NULL);
+  }
+  pthread_cond_destroy(&pool->workDone);
+  pthread_cond_destroy(&pool->workReady);
+  pthread_mutex_destroy(&pool->mutex);
+  free(pool->threads);
+  free(pool->segments);
+  free(pool);
+}
+
+//splits message and key into segments that are transformed at the same time by up to threadCount threads
+//threads only last for this call, so callers transforming many long messages should keep an OtpWorkerPool instead
+//returns 0 on success or -1 if message or key contain invalid characters
+int otpTransformParallel(OtpTransformFunction transformFunction, const char *message, const char *key, char *output, size_t length, int threadCount){
+  //don't start more threads than there are minimum length segments
+  size_t maxThreadCount = length / OTP_MIN_SEGMENT_LENGTH;
+  if((size_t)threadCount > maxThreadCount){
+    threadCount = maxThreadCount;
+  }
+  if(threadCount <= 1){
+    return transformFunction(message, key, output, length);
+  }
+  OtpWorkerPool *pool = otpWorkerPoolCreate(threadCount);
+  if(pool == NULL){
+    return transformFunction(message, key, output, length);
+  }
+  int returnValue = otpWorkerPoolTransform(pool, transformFunction, message, key, output, length);
+  otpWorkerPoolDestroy(pool);
+  return returnValue;
+}
+
+//fills key with length random characters A-Z or space using rand()
+//based on: https://www.tutorialspoint.com/c_standard_library/c_function_rand.htm
+void otpGenerateKey(char *key, size_t length){
+  size_t i;
+  for(i = 0; i < length; ++i){
+    key[i] = otpBase27ToChar(rand() % OTP_BASE);
+  }
+}
@@ -0,0 +1,81 @@
+/*
+ * One time pad library
+ * encodes, decodes and validates messages made up of A-Z and space characters
+ * in memory, so it can be used without connecting to a server
+ * link with libotp.a or libotp.so
+ */
+
+#ifndef OTP_H
+#define OTP_H
+
+#include <stddef.h>
+
+//number of different characters allowed in messages and keys (A-Z and space)
+#define OTP_BASE 27
+
+//segments used by otpTransformParallel start on multiples of this many characters
+//so threads don't share cache lines of output
+#define OTP_SEGMENT_ALIGNMENT 64
+
+//smallest number of characters given to each thread by otpTransformParallel
+#define OTP_MIN_SEGMENT_LENGTH 65536
+
+//function that combines length characters of message with key and stores result in output
+//returns 0 on success or -1 if message or key contain invalid characters
+typedef int (*OtpTransformFunction)(const char *message, const char *key, char *output, size_t length);
+
+//normalizes ASCII A-Z and space to int from 0-26 (base 27), with 0 being A and 26 being space
+//returns -1 if character is not A-Z or space
+int otpCharToBase27(char c);
+
+//reverse of otpCharToBase27
+//converts base 27 number to ASCII char A-Z or space (26 is space char, 0 is A)
+char otpBase27ToChar(int d);
+
+//returns 1 (true) if the first length characters of text are only A-Z or space, otherwise 0 (false)
+int otpIsValidText(const char *text, size_t length);
+
+//encodes length characters of message using key and stores result in output
+//output can be the same buffer as message to encode in place
+//returns 0 on success or -1 if message or key contain invalid characters
+int otpEncode(const char *message, const char *key, char *output, size_t length);
+
+//decodes length characters of encoded message using key and stores result in output
+//output can be the same buffer as message to decode in place
+//returns 0 on success or -1 if message or key contain invalid characters
+int otpDecode(const char *message, const char *key, char *output, size_t length);
+
+//combines length bytes of message with key using exclusive or and stores result in output
+//any byte values are allowed, and the same function both encodes and decodes
+//output can be the same buffer as message to transform in place
+//always returns 0, so it can be used as an OtpTransformFunction
+int otpXor(const char *message, const char *key, char *output, size_t length);
+
+//splits message and key into segments that are transformed at the same time by up to threadCount threads
+//segments are aligned to OTP_SEGMENT_ALIGNMENT characters and are at least OTP_MIN_SEGMENT_LENGTH long,
+//so fewer threads may be used for short messages
+//output can be the same buffer as message to transform in place
+//returns 0 on success or -1 if message or key contain invalid characters
+int otpTransformParallel(OtpTransformFunction transformFunction, const char *message, const char *key, char *output, size_t length, int threadCount);
+
+//threads kept waiting to transform segments of long messages, so they aren't started again for every message
+typedef struct OtpWorkerPool OtpWorkerPool;
+
+//starts threadCount - 1 threads, since the thread calling otpWorkerPoolTransform transforms one segment itself
+//fewer threads are used if some can't be started
+//returns NULL if pool can't be created
+OtpWorkerPool * otpWorkerPoolCreate(int threadCount);
+
+//transforms message the same way as otpTransformParallel, using the pool's threads
+//only one transform can run on a pool at a time
+//returns 0 on success or -1 if message or key contain invalid characters
+int otpWorkerPoolTransform(OtpWorkerPool *pool, OtpTransformFunction transformFunction, const char *message, const char *key, char *output, size_t length);
+
+//stops pool's threads and frees pool
+void otpWorkerPoolDestroy(OtpWorkerPool *pool);
+
+//fills key with length random characters A-Z or space using rand()
+//random number generator should be seeded by caller
+void otpGenerateKey(char *key, size_t length);
+
+#endif
@@ -0,0 +1,336 @@
+/*
+ * Benchmarks for transform functions, key generation and requests to a local server
+ * prints the median of several runs of each benchmark, one result per line as <name> <value>, which is also the format of the baseline file
+ * usage: otp_bench [--server <otp_enc_d_path>] [--baseline <file> [--threshold <percent>]]
+ * with a baseline, exits with an error if any result is worse than its baseline by more than threshold percent
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+//for transform functions and key generation
+#include "otp.h"
+//for requests to server
+#include "otp_client.h"
+//for starting local server
+#include "test_util.h"
+
+//number of characters transformed or generated at a time by in-memory benchmarks
+#define MEMORY_BENCHMARK_LENGTH 4194304
+
+//in-memory benchmarks repeat until they have run at least this long, so short runs aren't dominated by timer resolution
+#define MIN_BENCHMARK_SECONDS 0.25
+
+//benchmarks are run this many times, and the median result is used, so one slow or fast run doesn't cause failures
+#define BENCHMARK_RUN_COUNT 5
+
+//number and length of requests used to measure latency, which are sent one at a time
+#define LATENCY_REQUEST_COUNT 10000
+#define SMALL_REQUEST_LENGTH 32
+
+//number of small requests submitted at once to measure request rate
+#define SMALL_REQUEST_COUNT 200000
+
+//number and length of requests used to measure throughput
+#define LARGE_REQUEST_COUNT 1024
+#define LARGE_REQUEST_LENGTH 65536
+
+//number and length of xor requests used to measure throughput of requests long enough to be transformed by multiple threads
+#define XOR_REQUEST_COUNT 32
+#define XOR_REQUEST_LENGTH 4194304
+
+//connections to server used for request rate and throughput
+#define LOOPBACK_CONNECTION_COUNT 4
+
+//percent a result can be worse than its baseline before perf check fails
+#define DEFAULT_THRESHOLD_PERCENT 25.0
+
+//maximum number of characters in a baseline file line
+#define BASELINE_LINE_SIZE 256
+
+//result of one benchmark
+typedef struct BenchmarkResult{
+	const char *name;
+	double value;
+	//1 if higher values are better (throughput), or 0 if lower values are better (latency)
+	int isHigherBetter;
+	//value from each run so far
+	double runValues[BENCHMARK_RUN_COUNT];
+	int runCount;
+} BenchmarkResult;
+
+//all results, in the order they are printed
+#define RESULT_COUNT 8
+BenchmarkResult results[RESULT_COUNT] = {
+	{"encode_mb_per_s", 0, 1},
+	{"encode_parallel_mb_per_s", 0, 1},
+	{"xor_mb_per_s", 0, 1},
+	{"keygen_mb_per_s", 0, 1},
+	{"loopback_small_requests_per_s", 0, 1},
+	{"loopback_large_mb_per_s", 0, 1},
+	{"loopback_xor_large_mb_per_s", 0, 1},
+	{"loopback_small_p99_us", 0, 0}
+};
+
+//prints program usage
+void printUsage(const char *programName){
+	fprintf(stderr, "usage: %s [--server <otp_enc_d_path>] [--baseline <file> [--threshold <percent>]]\n", programName);
+}
+
+//returns current time in seconds from an arbitrary starting point
+double getSeconds(){
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+//used to sort latencies and run values
+int compareDoubles(const void *first, const void *second){
+	double difference = *(const double *)first - *(const double *)second;
+	return (difference > 0) - (difference < 0);
+}
+
+//records value of result with name from one run
+void setResult(const char *name, double value){
+	int i;
+	for(i = 0; i < RESULT_COUNT; ++i){
+		if(strcmp(results[i].name, name) == 0 && results[i].runCount < BENCHMARK_RUN_COUNT){
+			results[i].runValues[results[i].runCount++] = value;
+		}
+	}
+}
+
+//sets value of each result to the median of its runs
+void setMedianResults(void){
+	int i;
+	for(i = 0; i < RESULT_COUNT; ++i){
+		qsort(results[i].runValues, results[i].runCount, sizeof(double), compareDoubles);
+		results[i].value = results[i].runCount > 0 ? results[i].runValues[results[i].runCount / 2] : 0;
+	}
+}
+
+
+/*
+ * In-memory benchmarks
+ */
+//returns megabytes per second transformed by transformFunction
+double benchmarkTransform(OtpTransformFunction transformFunction, const char *message, const char *key, char *output){
+	double startTime = getSeconds();
+	double elapsedSeconds;
+	long repeatCount = 0;
+	do{
+		transformFunction(message, key, output, MEMORY_BENCHMARK_LENGTH);
+		repeatCount++;
+		elapsedSeconds = getSeconds() - startTime;
+	}while(elapsedSeconds < MIN_BENCHMARK_SECONDS);
+	return repeatCount * (MEMORY_BENCHMARK_LENGTH / 1048576.0) / elapsedSeconds;
+}
+
+//threads used by encodeParallel, kept for all runs the same way servers keep them for a connection
+OtpWorkerPool *workerPool = NULL;
+
+//encodes using one thread per processor, the same way servers transform long messages
+int encodeParallel(const char *message, const char *key, char *output, size_t length){
+	return otpWorkerPoolTransform(workerPool, &otpEncode, message, key, output, length);
+}
+
+//returns megabytes of key generated per second
+double benchmarkKeyGeneration(char *key){
+	double startTime = getSeconds();
+	double elapsedSeconds;
+	long repeatCount = 0;
+	do{
+		otpGenerateKey(key, MEMORY_BENCHMARK_LENGTH);
+		repeatCount++;
+		elapsedSeconds = getSeconds() - startTime;
+	}while(elapsedSeconds < MIN_BENCHMARK_SECONDS);
+	return repeatCount * (MEMORY_BENCHMARK_LENGTH / 1048576.0) / elapsedSeconds;
+}
+
+void runMemoryBenchmarks(){
+	char *message = malloc(MEMORY_BENCHMARK_LENGTH);
+	char *key = malloc(MEMORY_BENCHMARK_LENGTH);
+	char *output = malloc(MEMORY_BENCHMARK_LENGTH);
+	if(message == NULL || key == NULL || output == NULL){
+		fprintf(stderr, "Could not allocate memory for benchmarks\n");
+		exit(1);
+	}
+	otpGenerateKey(message, MEMORY_BENCHMARK_LENGTH);
+	otpGenerateKey(key, MEMORY_BENCHMARK_LENGTH);
+	workerPool = otpWorkerPoolCreate(sysconf(_SC_NPROCESSORS_ONLN));
+	if(workerPool == NULL){
+		fprintf(stderr, "Could not start threads for benchmarks\n");
+		exit(1);
+	}
+
+	int run;
+	for(run = 0; run < BENCHMARK_RUN_COUNT; ++run){
+		setResult("encode_mb_per_s", benchmarkTransform(&otpEncode, message, key, output));
+		setResult("encode_parallel_mb_per_s", benchmarkTransform(&encodeParallel, message, key, output));
+		setResult("xor_mb_per_s", benchmarkTransform(&otpXor, message, key, output));
+		setResult("keygen_mb_per_s", benchmarkKeyGeneration(output));
+	}
+
+	otpWorkerPoolDestroy(workerPool);
+	free(message);
+	free(key);
+	free(output);
+}
+
+
+/*
+ * Loopback benchmarks
+ */
+
+//counts requests that succeed, and remembers if any failed
+int completedRequestCount;
+int failedRequestCount;
+
+void countRequest(int status, const char *result, size_t resultLength, void *userData){
+	if(status == OTP_CLIENT_OK){
+		completedRequestCount++;
+	}
+	else{
+		failedRequestCount++;
+	}
+}
+
+//submits requestCount requests of requestType and length characters at once to pool and waits for all of them
+//returns number of seconds taken
+double timeRequests(OtpClientPool *pool, int requestType, const char *message, const char *key, size_t length, int requestCount){
+	double startTime = getSeconds();
+	int i;
+	for(i = 0; i < requestCount; ++i){
+		otpClientSubmit(pool, requestType, message, key, length, countRequest, NULL);
+	}
+	otpClientWaitAll(pool);
+	return getSeconds() - startTime;
+}
+
+void runLoopbackBenchmarks(const char *serverPath){
+	int port;
+	int serverProcessId = startServer(serverPath, &port);
+	OtpClientEndpoint endpoint = {"127.0.0.1", port, NULL};
+
+	//longest request is xor request, and text requests use the start of the same data
+	char *message = malloc(XOR_REQUEST_LENGTH);
+	char *key = malloc(XOR_REQUEST_LENGTH);
+	double *latencies = malloc(sizeof(double) * LATENCY_REQUEST_COUNT);
+	if(message == NULL || key == NULL || latencies == NULL){
+		fprintf(stderr, "Could not allocate memory for benchmarks\n");
+		exit(1);
+	}
+	otpGenerateKey(message, XOR_REQUEST_LENGTH);
+	otpGenerateKey(key, XOR_REQUEST_LENGTH);
+
+	int run;
+	for(run = 0; run < BENCHMARK_RUN_COUNT; ++run){
+		//one request at a time on one connection, so each latency is a full round trip
+		OtpClientPool *pool = otpClientPoolCreate(&endpoint, 1, 1);
+		int i;
+		for(i = 0; i < LATENCY_REQUEST_COUNT; ++i){
+			latencies[i] = timeRequests(pool, OTP_CLIENT_ENCODE, message, key, SMALL_REQUEST_LENGTH, 1);
+		}
+		otpClientPoolDestroy(pool);
+		qsort(latencies, LATENCY_REQUEST_COUNT, sizeof(double), compareDoubles);
+		setResult("loopback_small_p99_us", latencies[LATENCY_REQUEST_COUNT * 99 / 100] * 1e6);
+
+		pool = otpClientPoolCreate(&endpoint, 1, LOOPBACK_CONNECTION_COUNT);
+		double elapsedSeconds = timeRequests(pool, OTP_CLIENT_ENCODE, message, key, SMALL_REQUEST_LENGTH, SMALL_REQUEST_COUNT);
+		setResult("loopback_small_requests_per_s", SMALL_REQUEST_COUNT / elapsedSeconds);
+		elapsedSeconds = timeRequests(pool, OTP_CLIENT_ENCODE, message, key, LARGE_REQUEST_LENGTH, LARGE_REQUEST_COUNT);
+		setResult("loopback_large_mb_per_s", LARGE_REQUEST_COUNT * (LARGE_REQUEST_LENGTH / 1048576.0) / elapsedSeconds);
+		//long enough for the server to use multiple threads
+		elapsedSeconds = timeRequests(pool, OTP_CLIENT_XOR, message, key, XOR_REQUEST_LENGTH, XOR_REQUEST_COUNT);
+		setResult("loopback_xor_large_mb_per_s", XOR_REQUEST_COUNT * (XOR_REQUEST_LENGTH / 1048576.0) / elapsedSeconds);
+		otpClientPoolDestroy(pool);
+	}
+
+	//server finishes its connections and exits
+	stopServer(serverProcessId);
+	free(message);
+	free(key);
+	free(latencies);
+
+	int expectedRequestCount = BENCHMARK_RUN_COUNT * (LATENCY_REQUEST_COUNT + SMALL_REQUEST_COUNT + LARGE_REQUEST_COUNT + XOR_REQUEST_COUNT);
+	if(failedRequestCount > 0 || completedRequestCount != expectedRequestCount){
+		fprintf(stderr, "%d of %d requests to %s failed\n", expectedRequestCount - completedRequestCount, expectedRequestCount, serverPath);
+		exit(1);
+	}
+}
+
+
+/*
+ * Baseline comparison
+ */
+//compares results with baseline file, and prints results that are worse by more than thresholdPercent
+//results missing from the baseline file aren't checked
+//returns number of results that regressed
+int compareWithBaseline(const char *baselineFileName, double thresholdPercent){
+	FILE *baselineFile = fopen(baselineFileName, "r");
+	if(baselineFile == NULL){
+		fprintf(stderr, "Could not open baseline file %s\n", baselineFileName);
+		exit(1);
+	}
+	int regressionCount = 0;
+	char line[BASELINE_LINE_SIZE];
+	while(fgets(line, sizeof(line), baselineFile) != NULL){
+		char name[BASELINE_LINE_SIZE];
+		double baselineValue;
+		//blank lines and comments are skipped
+		if(line[0] == '#' || sscanf(line, "%255s %lf", name, &baselineValue) != 2){
+			continue;
+		}
+		int i;
+		for(i = 0; i < RESULT_COUNT; ++i){
+			if(strcmp(results[i].name, name) != 0){
+				continue;
+			}
+			double changePercent = (results[i].value - baselineValue) / baselineValue * 100;
+			double regressionPercent = results[i].isHigherBetter ? -changePercent : changePercent;
+			if(regressionPercent > thresholdPercent){
+				fprintf(stderr, "REGRESSION %s: %.1f, baseline %.1f (%.1f%% worse, threshold %.1f%%)\n", name, results[i].value, baselineValue, regressionPercent, thresholdPercent);
+				regressionCount++;
+			}
+		}
+	}
+	fclose(baselineFile);
+	return regressionCount;
+}
+
+
+int main(int argc, char **argv){
+	const char *serverPath = "./otp_enc_d";
+	const char *baselineFileName = NULL;
+	double thresholdPercent = DEFAULT_THRESHOLD_PERCENT;
+	int i;
+	for(i = 1; i < argc; ++i){
+		if(strcmp(argv[i], "--server") == 0 && i + 1 < argc){
+			serverPath = argv[++i];
+		}
+		else if(strcmp(argv[i], "--baseline") == 0 && i + 1 < argc){
+			baselineFileName = argv[++i];
+		}
+		else if(strcmp(argv[i], "--threshold") == 0 && i + 1 < argc){
+			thresholdPercent = atof(argv[++i]);
+		}
+		else{
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	runMemoryBenchmarks();
+	runLoopbackBenchmarks(serverPath);
+	setMedianResults();
+
+	for(i = 0; i < RESULT_COUNT; ++i){
+		printf("%s %.1f\n", results[i].name, results[i].value);
+	}
+	if(baselineFileName != NULL && compareWithBaseline(baselineFileName, thresholdPercent) > 0){
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,837 @@
+/*
+ * Checks for compression and for request framings of local servers
+ * built with address and undefined behavior sanitizers by make check, so out of bounds accesses fail too
+ * usage: otp_check [--programs <directory>]
+ * directory is where otp_enc_d and otp_dec_d are, and prints each failed check and exits with an error if any fail
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+//for transform functions
+#include "otp.h"
+//for batch requests
+#include "otp_client.h"
+//for compressed stream requests
+#include "otp_compress.h"
+//for sending requests and reading results
+#include "socket_io.h"
+//for starting local servers
+#include "test_util.h"
+//for request headers and limits
+#include "otp_protocol.h"
+
+//number of times each compressed sample is changed and decompressed
+#define FUZZ_MUTATION_COUNT 2000
+
+//number of short requests sent as batches
+#define BATCH_REQUEST_COUNT 500
+
+//length of message split across two servers, long enough that even split into STRIPES_PER_SERVER stripes each
+//a stripe would be longer than a server's buffer, so otp_enc has to send more, shorter stripes
+#define STRIPE_MESSAGE_LENGTH 1000000
+
+//maximum number of characters in a line from a server that isn't a result
+#define LINE_BUFFER_SIZE 64
+
+//number of checks that failed
+int failureCount;
+
+//prints description of check if it failed
+void check(int isPassed, const char *description){
+	if(!isPassed){
+		fprintf(stderr, "FAIL %s\n", description);
+		failureCount++;
+	}
+}
+
+//allocates memory, exiting if it can't
+void * allocate(size_t size){
+	//malloc(0) can return NULL, so always allocate at least one byte
+	void *data = malloc(size > 0 ? size : 1);
+	if(data == NULL){
+		fprintf(stderr, "Could not allocate memory for checks\n");
+		exit(1);
+	}
+	return data;
+}
+
+//kinds of data compressed by checks
+#define SAMPLE_WORDS 0
+#define SAMPLE_TEXT 1
+#define SAMPLE_REPEATED 2
+#define SAMPLE_BYTES 3
+#define SAMPLE_KIND_COUNT 4
+
+//fills data with length characters of given kind
+//words repeat, so they compress well, while random text and bytes don't
+void fillSample(char *data, size_t length, int kind){
+	const char *words[] = {"THE ", "QUICK ", "BROWN ", "FOX ", "JUMPS ", "OVER ", "LAZY ", "DOG "};
+	size_t fill = 0;
+	while(fill < length){
+		if(kind == SAMPLE_WORDS){
+			const char *word = words[rand() % 8];
+			size_t wordLength = strlen(word) < length - fill ? strlen(word) : length - fill;
+			memcpy(data + fill, word, wordLength);
+			fill += wordLength;
+		}
+		else if(kind == SAMPLE_TEXT){
+			data[fill++] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ "[rand() % OTP_BASE];
+		}
+		else if(kind == SAMPLE_REPEATED){
+			data[fill++] = 'A';
+		}
+		else{
+			data[fill++] = rand();
+		}
+	}
+}
+
+
+/*
+ * Compression
+ */
+//largest compressed size of length bytes, when nothing matches and everything is stored as literals
+size_t getCompressedSizeLimit(size_t length){
+	return length + length / 255 + 16;
+}
+
+//decompresses changed and cut short copies of compressed data into a buffer of exactly length bytes
+//results don't matter, as long as they are errors or fit in the buffer, and the sanitizers find nothing
+void fuzzDecompression(const char *compressed, size_t compressedLength, size_t length){
+	char *changed = allocate(compressedLength);
+	char *output = allocate(length);
+	int i;
+	for(i = 0; i < FUZZ_MUTATION_COUNT; ++i){
+		memcpy(changed, compressed, compressedLength);
+		int changeCount = 1 + rand() % 4;
+		while(changeCount-- > 0 && compressedLength > 0){
+			changed[rand() % compressedLength] ^= 1 << (rand() % 8);
+		}
+		size_t changedLength = rand() % 2 == 0 ? compressedLength : rand() % (compressedLength + 1);
+		long outputLength = otpDecompress(changed, changedLength, output, length);
+		check(outputLength >= -1 && outputLength <= (long)length, "decompressing changed data stays within output");
+	}
+	//random data instead of compressed data
+	for(i = 0; i < FUZZ_MUTATION_COUNT; ++i){
+		size_t changedLength = rand() % (compressedLength + 1);
+		fillSample(changed, changedLength, SAMPLE_BYTES);
+		long outputLength = otpDecompress(changed, changedLength, output, length);
+		check(outputLength >= -1 && outputLength <= (long)length, "decompressing random data stays within output");
+	}
+	free(changed);
+	free(output);
+}
+
+//number of threads in worker pool used by checkWorkerPool, more than most computers running the checks have processors
+#define CHECK_WORKER_THREAD_COUNT 4
+
+//transforms messages of several lengths with one worker pool, one after another the way a server connection does,
+//and checks that the results are the same as transforming them with one thread
+void checkWorkerPool(){
+	size_t lengths[] = {0, 1, OTP_MIN_SEGMENT_LENGTH, 2 * OTP_MIN_SEGMENT_LENGTH + 1, 3 * OTP_MIN_SEGMENT_LENGTH - 7, 1000000, 130, 4 * OTP_MIN_SEGMENT_LENGTH};
+	int lengthCount = sizeof(lengths) / sizeof(lengths[0]);
+	OtpWorkerPool *pool = otpWorkerPoolCreate(CHECK_WORKER_THREAD_COUNT);
+	check(pool != NULL, "worker pool is created");
+	int i;
+	for(i = 0; pool != NULL && i < lengthCount; ++i){
+		size_t length = lengths[i];
+		char *message = allocate(length);
+		char *key = allocate(length);
+		char *expected = allocate(length);
+		char *output = allocate(length);
+		fillSample(message, length, SAMPLE_TEXT);
+		otpGenerateKey(key, length);
+		otpEncode(message, key, expected, length);
+		check(otpWorkerPoolTransform(pool, &otpEncode, message, key, output, length) == 0 && memcmp(output, expected, length) == 0, "worker pool result matches single thread encoding");
+		check(otpTransformParallel(&otpEncode, message, key, output, length, CHECK_WORKER_THREAD_COUNT) == 0 && memcmp(output, expected, length) == 0, "parallel transform result matches single thread encoding");
+		//an invalid character in the last segment has to be reported too
+		if(length > 0){
+			message[length - 1] = 'a';
+			check(otpWorkerPoolTransform(pool, &otpEncode, message, key, output, length) == -1, "worker pool reports invalid characters");
+		}
+		free(message);
+		free(key);
+		free(expected);
+		free(output);
+	}
+	otpWorkerPoolDestroy(pool);
+}
+
+void checkCompression(){
+	size_t lengths[] = {0, 1, 3, 4, 5, 15, 16, 19, 20, 270, 1000, 65536, 200000};
+	int lengthCount = sizeof(lengths) / sizeof(lengths[0]);
+	int kind;
+	for(kind = 0; kind < SAMPLE_KIND_COUNT; ++kind){
+		int i;
+		for(i = 0; i < lengthCount; ++i){
+			size_t length = lengths[i];
+			//buffers are exactly as big as they have to be, so the sanitizers find any access past their ends
+			char *input = allocate(length);
+			char *compressed = allocate(getCompressedSizeLimit(length));
+			char *output = allocate(length);
+			fillSample(input, length, kind);
+
+			size_t compressedLength = otpCompress(input, length, compressed, getCompressedSizeLimit(length));
+			check(compressedLength > 0, "compressed data fits in size limit");
+			check(otpDecompress(compressed, compressedLength, output, length) == (long)length && memcmp(input, output, length) == 0, "compressed data decompresses to the original");
+			check(otpCompress(input, length, compressed, compressedLength - 1) == 0, "compression fails when output is too small");
+			if(length > 0){
+				check(otpDecompress(compressed, compressedLength, output, length - 1) == -1, "decompression fails when output is too small");
+			}
+			if(kind == SAMPLE_WORDS && length >= 1000){
+				check(compressedLength < length * 3 / 4, "repeated words compress to less than three quarters");
+			}
+			if(length <= STREAM_CHUNK_SIZE){
+				fuzzDecompression(compressed, compressedLength, length);
+			}
+
+			free(input);
+			free(compressed);
+			free(output);
+		}
+	}
+}
+
+
+/*
+ * Local servers
+ */
+
+//connects to server on port of this computer
+//returns file descriptor of connection, or -1 if server can't be reached
+int connectToPort(int port){
+	int fileDescriptor = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in serverAddress;
+	memset(&serverAddress, 0, sizeof(serverAddress));
+	serverAddress.sin_family = AF_INET;
+	serverAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	serverAddress.sin_port = htons(port);
+	if(fileDescriptor >= 0 && connect(fileDescriptor, (struct sockaddr *) &serverAddress, sizeof(serverAddress)) < 0){
+		close(fileDescriptor);
+		return -1;
+	}
+	return fileDescriptor;
+}
+
+//connects to server on port of this computer, and sends header
+//exits if server can't be reached, and returns 1 if server accepted header, otherwise 0
+int startRequest(BufferedConnection *connection, int port, const char *header){
+	int fileDescriptor = connectToPort(port);
+	if(fileDescriptor < 0){
+		perror("Could not connect to server");
+		exit(1);
+	}
+	initializeBufferedConnection(connection, fileDescriptor);
+	char line[LINE_BUFFER_SIZE];
+	return writeAllToSocket(fileDescriptor, header, strlen(header)) == 0 &&
+		readFromSocketUntilTerminator(connection, line, sizeof(line), '\n') >= 0 && strcmp(line, OK_MESSAGE) == 0;
+}
+
+//returns 1 if next line from server is an error, and the server then closes the connection
+int isErrorReceived(BufferedConnection *connection){
+	char line[LINE_BUFFER_SIZE];
+	char extra;
+	return readFromSocketUntilTerminator(connection, line, sizeof(line), '\n') >= 0 && line[0] == '@' &&
+		readFromSocketExactly(connection, &extra, 1) == SOCKET_IO_CLOSED;
+}
+
+
+/*
+ * Request framings
+ */
+//sends message in chunks of chunkLength characters as a stream request, and compares results with in-memory encoding
+void checkStream(int encodePort, const char *message, const char *key, size_t length, size_t chunkLength){
+	BufferedConnection connection;
+	check(startRequest(&connection, encodePort, ENCODE_REQUEST_NAME STREAM_MESSAGE_HEADER_SUFFIX), "stream header is accepted");
+	char *expected = allocate(length);
+	char *result = allocate(length);
+	otpEncode(message, key, expected, length);
+	size_t offset;
+	for(offset = 0; offset < length; offset += chunkLength){
+		size_t currentLength = length - offset < chunkLength ? length - offset : chunkLength;
+		char chunkHeader[LINE_BUFFER_SIZE];
+		snprintf(chunkHeader, sizeof(chunkHeader), "%zu\n", currentLength);
+		struct iovec vectors[3] = {
+			{chunkHeader, strlen(chunkHeader)},
+			{(char *)key + offset, currentLength},
+			{(char *)message + offset, currentLength}
+		};
+		check(writeVectorsToSocket(connection.fileDescriptor, vectors, 3) == 0 && readFromSocketExactly(&connection, result + offset, currentLength) >= 0, "stream chunk is transformed");
+	}
+	check(memcmp(result, expected, length) == 0, "stream result matches in-memory encoding");
+	//chunks longer than the server allows are refused
+	char line[LINE_BUFFER_SIZE];
+	int lineLength = snprintf(line, sizeof(line), "%d\n", STREAM_CHUNK_SIZE + 1);
+	writeAllToSocket(connection.fileDescriptor, line, lineLength);
+	check(isErrorReceived(&connection), "stream chunk that is too long is refused");
+	close(connection.fileDescriptor);
+	free(expected);
+	free(result);
+}
+
+//sends message as a compressed stream request, compressing it if the encoding server is used,
+//and compares results with in-memory encoding or decoding
+//returns number of result bytes received, not counting length lines
+size_t checkCompressedStream(int port, int isEncoding, const char *message, const char *key, size_t length){
+	BufferedConnection connection;
+	check(startRequest(&connection, port, isEncoding ? ENCODE_REQUEST_NAME COMPRESSED_STREAM_MESSAGE_HEADER_SUFFIX : DECODE_REQUEST_NAME COMPRESSED_STREAM_MESSAGE_HEADER_SUFFIX), "compressed stream header is accepted");
+	char *expected = allocate(length);
+	char *result = allocate(length);
+	char *compressed = allocate(STREAM_CHUNK_SIZE);
+	if(isEncoding){
+		otpEncode(message, key, expected, length);
+	}
+	else{
+		otpDecode(message, key, expected, length);
+	}
+	size_t receivedLength = 0;
+	size_t offset;
+	for(offset = 0; offset < length; offset += STREAM_CHUNK_SIZE){
+		size_t chunkLength = length - offset < STREAM_CHUNK_SIZE ? length - offset : STREAM_CHUNK_SIZE;
+		const char *messageData = message + offset;
+		size_t messageDataLength = chunkLength;
+		if(isEncoding){
+			size_t compressedLength = otpCompress(message + offset, chunkLength, compressed, chunkLength - 1);
+			if(compressedLength > 0){
+				messageData = compressed;
+				messageDataLength = compressedLength;
+			}
+		}
+		char line[LINE_BUFFER_SIZE];
+		snprintf(line, sizeof(line), "%zu %zu\n", chunkLength, messageDataLength);
+		struct iovec vectors[3] = {
+			{line, strlen(line)},
+			{(char *)key + offset, chunkLength},
+			{(char *)messageData, messageDataLength}
+		};
+		long resultDataLength = -1;
+		if(writeVectorsToSocket(connection.fileDescriptor, vectors, 3) == 0 && readFromSocketUntilTerminator(&connection, line, sizeof(line), '\n') >= 0){
+			resultDataLength = atol(line);
+		}
+		int isReceived = resultDataLength > 0 && resultDataLength <= (long)chunkLength;
+		if(isReceived && resultDataLength == (long)chunkLength){
+			isReceived = readFromSocketExactly(&connection, result + offset, chunkLength) >= 0;
+		}
+		else if(isReceived){
+			isReceived = readFromSocketExactly(&connection, compressed, resultDataLength) >= 0 &&
+				otpDecompress(compressed, resultDataLength, result + offset, chunkLength) == (long)chunkLength;
+		}
+		check(isReceived, "compressed stream chunk is transformed");
+		if(!isReceived){
+			break;
+		}
+		receivedLength += resultDataLength;
+	}
+	check(memcmp(result, expected, length) == 0, "compressed stream result matches in-memory transform");
+	//data that doesn't decompress to the declared length is refused
+	char invalidChunk[] = "8 3\nABCDEFGH\xff\x00\x00";
+	writeAllToSocket(connection.fileDescriptor, invalidChunk, sizeof(invalidChunk) - 1);
+	check(isErrorReceived(&connection), "compressed stream chunk that doesn't decompress is refused");
+	close(connection.fileDescriptor);
+	free(expected);
+	free(result);
+	free(compressed);
+	return receivedLength;
+}
+
+void checkStreams(int encodePort, int decodePort){
+	size_t length = 200000;
+	char *message = allocate(length);
+	char *key = allocate(length);
+	char *ciphertext = allocate(length);
+	fillSample(message, length, SAMPLE_WORDS);
+	otpGenerateKey(key, length);
+	otpEncode(message, key, ciphertext, length);
+
+	checkStream(encodePort, message, key, length, STREAM_CHUNK_SIZE);
+	checkStream(encodePort, message, key, 1000, 1);
+	//encoding server returns ciphertext, which doesn't compress, and decoding server returns plaintext, which does
+	check(checkCompressedStream(encodePort, 1, message, key, length) == length, "compressed stream ciphertext is sent uncompressed");
+	check(checkCompressedStream(decodePort, 0, ciphertext, key, length) < length * 3 / 4, "compressed stream plaintext is compressed");
+
+	free(message);
+	free(key);
+	free(ciphertext);
+}
+
+//request sent by checkBatches, with its expected result
+typedef struct BatchCheck{
+	char message[64];
+	char key[64];
+	char expected[64];
+	size_t length;
+	int isValid;
+	int isFinished;
+} BatchCheck;
+
+void finishBatchCheck(int status, const char *result, size_t resultLength, void *userData){
+	BatchCheck *request = userData;
+	request->isFinished = 1;
+	if(request->isValid){
+		check(status == OTP_CLIENT_OK && resultLength == request->length && memcmp(result, request->expected, resultLength) == 0, "batch result matches in-memory encoding");
+	}
+	else{
+		check(status == OTP_CLIENT_ERROR_SERVER, "invalid request in batch gets an error");
+	}
+}
+
+//sends many short requests at once, which the client library sends in batches, with some invalid ones among them
+void checkBatches(int encodePort){
+	OtpClientEndpoint endpoint = {"127.0.0.1", encodePort, NULL};
+	OtpClientPool *pool = otpClientPoolCreate(&endpoint, 1, 1);
+	BatchCheck *requests = allocate(sizeof(BatchCheck) * BATCH_REQUEST_COUNT);
+	int i;
+	for(i = 0; i < BATCH_REQUEST_COUNT; ++i){
+		BatchCheck *request = &requests[i];
+		request->length = 1 + rand() % (sizeof(request->message) - 1);
+		fillSample(request->message, request->length, SAMPLE_TEXT);
+		otpGenerateKey(request->key, request->length);
+		otpEncode(request->message, request->key, request->expected, request->length);
+		request->isValid = i % 50 != 7;
+		if(!request->isValid){
+			request->message[0] = 'a';
+		}
+		request->isFinished = 0;
+		check(otpClientSubmit(pool, OTP_CLIENT_ENCODE, request->message, request->key, request->length, &finishBatchCheck, request) == 0, "batch request is submitted");
+	}
+	check(otpClientWaitAll(pool) == 0, "batch requests finish");
+	for(i = 0; i < BATCH_REQUEST_COUNT; ++i){
+		check(requests[i].isFinished, "every batch request gets a result");
+	}
+	otpClientPoolDestroy(pool);
+	free(requests);
+}
+
+//request sent by checkFullUnixQueue, with its expected result
+typedef struct FullQueueCheck{
+	char expected[8];
+	int isFinished;
+} FullQueueCheck;
+
+void finishFullQueueCheck(int status, const char *result, size_t resultLength, void *userData){
+	FullQueueCheck *request = userData;
+	request->isFinished = 1;
+	check(status == OTP_CLIENT_OK && resultLength == strlen(request->expected) && memcmp(result, request->expected, resultLength) == 0, "request to full unix domain socket succeeds once server accepts");
+}
+
+//sends a request to a server whose unix domain socket's listen queue is full while the server is stopped
+//unix domain sockets refuse connections to a full queue instead of waiting, so the client has to try again
+//until the server starts accepting connections again
+void checkFullUnixQueue(const char *encodeServerPath){
+	char directory[] = "/tmp/otp_check_XXXXXX";
+	if(mkdtemp(directory) == NULL){
+		fprintf(stderr, "Could not create directory for checks\n");
+		exit(1);
+	}
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	snprintf(address.sun_path, sizeof(address.sun_path), "%s/socket", directory);
+	int port;
+	int serverProcessId = startServerWithUnixSocket(encodeServerPath, &port, address.sun_path, 0);
+	kill(serverProcessId, SIGSTOP);
+	waitpid(serverProcessId, NULL, WUNTRACED);
+
+	//fill listen queue
+	int queuedFileDescriptors[LINE_BUFFER_SIZE];
+	int queuedCount = 0;
+	while(queuedCount < LINE_BUFFER_SIZE){
+		int fileDescriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+		fcntl(fileDescriptor, F_SETFL, O_NONBLOCK);
+		queuedFileDescriptors[queuedCount++] = fileDescriptor;
+		if(connect(fileDescriptor, (struct sockaddr *)&address, sizeof(address)) < 0 && errno == EAGAIN){
+			break;
+		}
+	}
+	check(queuedCount < LINE_BUFFER_SIZE, "unix domain socket listen queue fills up");
+
+	//server is continued shortly after the request is submitted, while the client is still trying to connect
+	int continueProcessId = fork();
+	if(continueProcessId == 0){
+		usleep(10000);
+		kill(serverProcessId, SIGCONT);
+		_exit(0);
+	}
+	OtpClientEndpoint endpoint = {NULL, 0, address.sun_path};
+	OtpClientPool *pool = otpClientPoolCreate(&endpoint, 1, 1);
+	FullQueueCheck request = {"", 0};
+	otpEncode("HELLO", "XMCKL", request.expected, 5);
+	check(otpClientSubmit(pool, OTP_CLIENT_ENCODE, "HELLO", "XMCKL", 5, &finishFullQueueCheck, &request) == 0, "request to full unix domain socket is submitted");
+	//polled with a time limit, so the check fails instead of hanging if the request never finishes
+	int pollCount;
+	for(pollCount = 0; pollCount < 50 && !request.isFinished; ++pollCount){
+		otpClientPoll(pool, 100);
+	}
+	check(request.isFinished, "request to full unix domain socket finishes");
+	otpClientPoolDestroy(pool);
+	waitpid(continueProcessId, NULL, 0);
+
+	while(queuedCount > 0){
+		close(queuedFileDescriptors[--queuedCount]);
+	}
+	stopServer(serverProcessId);
+	unlink(address.sun_path);
+	rmdir(directory);
+}
+
+
+//writes length characters of data and a newline to file in directory, and stores its path in path
+void writeLineFile(char *path, size_t pathSize, const char *directory, const char *fileName, const char *data, size_t length){
+	snprintf(path, pathSize, "%s/%s", directory, fileName);
+	FILE *file = fopen(path, "w");
+	if(file == NULL || fwrite(data, 1, length, file) != length || fputc('\n', file) == EOF || fclose(file) != 0){
+		fprintf(stderr, "Could not write %s\n", path);
+		exit(1);
+	}
+}
+
+//encodes a message of length characters with otp_enc run with the given port argument
+//and checks that it prints the same result as encoding in memory
+//if streamOptions isn't NULL, otp_enc is run in stream mode with those options, and the message is its stdin
+//key is longer than message, so otp_enc has to send only the part of it that the message needs
+void checkProgramEncoding(const char *programDirectory, const char *streamOptions, const char *portArgument, size_t length, const char *description){
+	size_t keyLength = length + 1;
+	char *message = allocate(length);
+	char *key = allocate(keyLength);
+	char *expected = allocate(length + 1);
+	char *result = allocate(length + 2);
+	fillSample(message, length, SAMPLE_TEXT);
+	otpGenerateKey(key, keyLength);
+	otpEncode(message, key, expected, length);
+	expected[length] = '\n';
+
+	char directory[] = "/tmp/otp_check_XXXXXX";
+	if(mkdtemp(directory) == NULL){
+		fprintf(stderr, "Could not create directory for checks\n");
+		exit(1);
+	}
+	char messagePath[4096];
+	char keyPath[4096];
+	writeLineFile(messagePath, sizeof(messagePath), directory, "message", message, length);
+	writeLineFile(keyPath, sizeof(keyPath), directory, "key", key, keyLength);
+
+	char command[16384];
+	if(streamOptions != NULL){
+		snprintf(command, sizeof(command), "%s/otp_enc %s %s %s < %s", programDirectory, streamOptions, keyPath, portArgument, messagePath);
+	}
+	else{
+		snprintf(command, sizeof(command), "%s/otp_enc %s %s %s", programDirectory, messagePath, keyPath, portArgument);
+	}
+	FILE *output = popen(command, "r");
+	if(output == NULL){
+		fprintf(stderr, "Could not run %s\n", command);
+		exit(1);
+	}
+	size_t resultLength = fread(result, 1, length + 2, output);
+	check(pclose(output) == 0, description);
+	check(resultLength == length + 1 && memcmp(result, expected, resultLength) == 0, description);
+
+	unlink(messagePath);
+	unlink(keyPath);
+	rmdir(directory);
+	free(message);
+	free(key);
+	free(expected);
+	free(result);
+}
+
+//runs a manifest through otp_enc where only the first line has a valid key offset
+//and checks that only that line's result is written, and the others are reported as malformed
+void checkManifestOffsets(const char *programDirectory, int encodePort){
+	const char *messageText = "HELLO WORLD";
+	const char *keyText = "XMCKLQWERTYUIOPASDFGHJKLZX";
+	const char *invalidOffsets[] = {"12x", "abc", "-1", "1.5"};
+	size_t messageLength = strlen(messageText);
+	char expected[LINE_BUFFER_SIZE];
+	otpEncode(messageText, keyText + 2, expected, messageLength);
+	expected[messageLength] = '\n';
+
+	char directory[] = "/tmp/otp_check_XXXXXX";
+	if(mkdtemp(directory) == NULL){
+		fprintf(stderr, "Could not create directory for checks\n");
+		exit(1);
+	}
+	char messagePath[4096];
+	char keyPath[4096];
+	char manifestPath[4096];
+	char outputPaths[5][4096];
+	writeLineFile(messagePath, sizeof(messagePath), directory, "message", messageText, messageLength);
+	writeLineFile(keyPath, sizeof(keyPath), directory, "key", keyText, strlen(keyText));
+	snprintf(manifestPath, sizeof(manifestPath), "%s/manifest", directory);
+	FILE *manifest = fopen(manifestPath, "w");
+	if(manifest == NULL){
+		fprintf(stderr, "Could not write %s\n", manifestPath);
+		exit(1);
+	}
+	int i;
+	for(i = 0; i < 5; ++i){
+		snprintf(outputPaths[i], sizeof(outputPaths[i]), "%s/output%d", directory, i);
+		fprintf(manifest, "%s %s %s %s\n", messagePath, keyPath, outputPaths[i], i == 0 ? "2" : invalidOffsets[i - 1]);
+	}
+	fclose(manifest);
+
+	char command[16384];
+	snprintf(command, sizeof(command), "%s/otp_enc -m %s %d 2> /dev/null", programDirectory, manifestPath, encodePort);
+	check(system(command) != 0, "manifest with malformed key offsets fails");
+	char result[LINE_BUFFER_SIZE];
+	FILE *output = fopen(outputPaths[0], "r");
+	size_t resultLength = output != NULL ? fread(result, 1, sizeof(result), output) : 0;
+	check(resultLength == messageLength + 1 && memcmp(result, expected, resultLength) == 0, "manifest line with valid key offset is encoded");
+	if(output != NULL){
+		fclose(output);
+	}
+	for(i = 0; i < 5; ++i){
+		check(i == 0 || access(outputPaths[i], F_OK) != 0, "manifest line with malformed key offset is not encoded");
+		unlink(outputPaths[i]);
+	}
+
+	unlink(manifestPath);
+	unlink(messagePath);
+	unlink(keyPath);
+	rmdir(directory);
+}
+
+//encodes the longest message that fits in a server's buffer as one text request,
+//a message longer than a server's buffer split across two servers,
+//and a message of many chunks in stream and compressed stream mode, where several chunks are sent before results are read
+void checkPrograms(const char *programDirectory, int encodePort, int secondEncodePort){
+	char portArgument[LINE_BUFFER_SIZE];
+	snprintf(portArgument, sizeof(portArgument), "%d", encodePort);
+	//buffer holds the message, its terminator and a null char
+	checkProgramEncoding(programDirectory, NULL, portArgument, MESSAGE_BUFFER_SIZE - 2, "longest text request is encoded");
+	checkProgramEncoding(programDirectory, "-s", portArgument, STRIPE_MESSAGE_LENGTH, "stream request is encoded");
+	checkProgramEncoding(programDirectory, "-s -z", portArgument, STRIPE_MESSAGE_LENGTH, "compressed stream request is encoded");
+	snprintf(portArgument, sizeof(portArgument), "%d,%d", encodePort, secondEncodePort);
+	checkProgramEncoding(programDirectory, NULL, portArgument, STRIPE_MESSAGE_LENGTH, "striped request is encoded");
+}
+
+
+/*
+ * Stopping and restarting servers
+ */
+
+//number of times a server is checked for having stopped, and milliseconds between checks
+//long enough for a new server to start and tell the old one it is ready, even with sanitizers
+#define SERVER_WAIT_COUNT 500
+#define SERVER_WAIT_MILLISECONDS 20
+
+//sends the rest of a text request started by startRequest, and returns 1 if the result matches in-memory encoding
+int isTextRequestFinished(BufferedConnection *connection, const char *message, const char *key){
+	size_t length = strlen(message);
+	char expected[LINE_BUFFER_SIZE];
+	char line[LINE_BUFFER_SIZE];
+	//result line keeps its terminator
+	otpEncode(message, key, expected, length);
+	expected[length] = DATA_TERMINATING_CHAR;
+	expected[length + 1] = '\0';
+	struct iovec keyVectors[2] = {{(char *)key, length}, {"\n", 1}};
+	struct iovec messageVectors[2] = {{(char *)message, length}, {"\n", 1}};
+	return writeVectorsToSocket(connection->fileDescriptor, keyVectors, 2) == 0 &&
+		readFromSocketUntilTerminator(connection, line, sizeof(line), '\n') >= 0 && strcmp(line, OK_MESSAGE) == 0 &&
+		writeVectorsToSocket(connection->fileDescriptor, messageVectors, 2) == 0 &&
+		readFromSocketUntilTerminator(connection, line, sizeof(line), '\n') >= 0 && strcmp(line, expected) == 0;
+}
+
+//returns 1 if a whole text request to server on port is encoded, or 0 if it isn't or the server can't be reached
+int isTextRequestEncoded(int port){
+	int fileDescriptor = connectToPort(port);
+	if(fileDescriptor < 0){
+		return 0;
+	}
+	BufferedConnection connection;
+	initializeBufferedConnection(&connection, fileDescriptor);
+	char line[LINE_BUFFER_SIZE];
+	int isEncoded = writeAllToSocket(fileDescriptor, ENCODE_MESSAGE_HEADER, strlen(ENCODE_MESSAGE_HEADER)) == 0 &&
+		readFromSocketUntilTerminator(&connection, line, sizeof(line), '\n') >= 0 && strcmp(line, OK_MESSAGE) == 0 &&
+		isTextRequestFinished(&connection, "HELLO", "XMCKL");
+	close(fileDescriptor);
+	return isEncoded;
+}
+
+//returns 1 once connections to port are refused, or 0 if they are still accepted after waiting
+//servers started by a restart aren't children of this process, so this is how they are seen to stop
+int isPortClosed(int port){
+	int waitCount;
+	for(waitCount = 0; waitCount < SERVER_WAIT_COUNT; ++waitCount){
+		int fileDescriptor = connectToPort(port);
+		if(fileDescriptor < 0){
+			return 1;
+		}
+		close(fileDescriptor);
+		usleep(SERVER_WAIT_MILLISECONDS * 1000);
+	}
+	return 0;
+}
+
+//returns 1 once child process serverProcessId has exited, or 0 if it is still running after waiting
+int isServerExited(int serverProcessId){
+	int waitCount;
+	for(waitCount = 0; waitCount < SERVER_WAIT_COUNT; ++waitCount){
+		if(waitpid(serverProcessId, NULL, WNOHANG) == serverProcessId){
+			return 1;
+		}
+		usleep(SERVER_WAIT_MILLISECONDS * 1000);
+	}
+	return 0;
+}
+
+//returns 1 once file at path contains text, or 0 if it doesn't after waiting
+int isTextLogged(const char *path, const char *text){
+	int waitCount;
+	for(waitCount = 0; waitCount < SERVER_WAIT_COUNT; ++waitCount){
+		char contents[4096];
+		size_t contentsLength = 0;
+		FILE *file = fopen(path, "r");
+		if(file != NULL){
+			contentsLength = fread(contents, 1, sizeof(contents) - 1, file);
+			fclose(file);
+		}
+		contents[contentsLength] = '\0';
+		if(strstr(contents, text) != NULL){
+			return 1;
+		}
+		usleep(SERVER_WAIT_MILLISECONDS * 1000);
+	}
+	return 0;
+}
+
+//sends SIGTERM to a server with a request in progress
+//server has to stop accepting connections straight away, but still finish the request before it exits
+void checkDrain(const char *encodeServerPath){
+	int port;
+	int serverProcessId = startServer(encodeServerPath, &port);
+	BufferedConnection connection;
+	check(startRequest(&connection, port, ENCODE_MESSAGE_HEADER), "text header is accepted before SIGTERM");
+	kill(serverProcessId, SIGTERM);
+	check(isPortClosed(port), "server stops accepting connections after SIGTERM");
+	check(isTextRequestFinished(&connection, "HELLO", "XMCKL"), "request in progress is finished after SIGTERM");
+	close(connection.fileDescriptor);
+	check(isServerExited(serverProcessId), "server exits once its connections are finished after SIGTERM");
+}
+
+//sends SIGHUP to a server started from a script, which fails instead of starting the server while a file exists
+//old server has to keep accepting connections if the new server doesn't start,
+//and hand them over and exit once a new server has started
+void checkRestart(const char *encodeServerPath){
+	char directory[] = "/tmp/otp_check_XXXXXX";
+	char serverPath[4096];
+	if(mkdtemp(directory) == NULL || realpath(encodeServerPath, serverPath) == NULL){
+		fprintf(stderr, "Could not create directory for checks\n");
+		exit(1);
+	}
+	char scriptPath[4096];
+	char processIdPath[4096];
+	char failurePath[4096];
+	char logPath[4096];
+	snprintf(scriptPath, sizeof(scriptPath), "%s/server", directory);
+	snprintf(processIdPath, sizeof(processIdPath), "%s/pid", directory);
+	snprintf(failurePath, sizeof(failurePath), "%s/fail", directory);
+	snprintf(logPath, sizeof(logPath), "%s/log", directory);
+	//script keeps its own path as the server's program name, so a restart runs the script again
+	FILE *script = fopen(scriptPath, "w");
+	if(script == NULL){
+		fprintf(stderr, "Could not write %s\n", scriptPath);
+		exit(1);
+	}
+	fprintf(script, "#!/bin/bash\necho $$ > '%s'\nif [ -e '%s' ]; then exit 1; fi\nexec -a \"$0\" '%s' \"$@\" 2>> '%s'\n", processIdPath, failurePath, serverPath, logPath);
+	fclose(script);
+	chmod(scriptPath, 0700);
+
+	int port;
+	int serverProcessId = startServer(scriptPath, &port);
+	check(isTextRequestEncoded(port), "request is encoded before restart");
+
+	//new server fails to start
+	FILE *failure = fopen(failurePath, "w");
+	if(failure != NULL){
+		fclose(failure);
+	}
+	kill(serverProcessId, SIGHUP);
+	check(isTextLogged(logPath, "did not start"), "failed restart is logged");
+	check(waitpid(serverProcessId, NULL, WNOHANG) == 0, "server keeps running after failed restart");
+	check(isTextRequestEncoded(port), "request is encoded after failed restart");
+
+	//new server starts
+	unlink(failurePath);
+	kill(serverProcessId, SIGHUP);
+	check(isServerExited(serverProcessId), "old server exits after restart");
+	check(isTextRequestEncoded(port), "request is encoded by new server after restart");
+	long newServerProcessId = 0;
+	FILE *processIdFile = fopen(processIdPath, "r");
+	if(processIdFile != NULL){
+		if(fscanf(processIdFile, "%ld", &newServerProcessId) != 1){
+			newServerProcessId = 0;
+		}
+		fclose(processIdFile);
+	}
+	check(newServerProcessId > 0 && newServerProcessId != serverProcessId, "new server is started by restart");
+	if(newServerProcessId > 0 && newServerProcessId != serverProcessId){
+		kill(newServerProcessId, SIGTERM);
+		check(isPortClosed(port), "new server stops after SIGTERM");
+	}
+
+	unlink(scriptPath);
+	unlink(processIdPath);
+	unlink(logPath);
+	rmdir(directory);
+}
+
+int main(int argc, char **argv){
+	const char *programDirectory = ".";
+	if(argc == 3 && strcmp(argv[1], "--programs") == 0){
+		programDirectory = argv[2];
+	}
+	else if(argc != 1){
+		fprintf(stderr, "usage: %s [--programs <directory>]\n", argv[0]);
+		return 1;
+	}
+	//same data every run, so failures can be repeated
+	srand(1);
+	//server closing a connection after an error shouldn't stop the checks
+	signal(SIGPIPE, SIG_IGN);
+
+	checkWorkerPool();
+	checkCompression();
+
+	char encodeServerPath[4096];
+	char decodeServerPath[4096];
+	snprintf(encodeServerPath, sizeof(encodeServerPath), "%s/otp_enc_d", programDirectory);
+	snprintf(decodeServerPath, sizeof(decodeServerPath), "%s/otp_dec_d", programDirectory);
+	int encodePort;
+	int decodePort;
+	int secondEncodePort;
+	int encodeServerProcessId = startServer(encodeServerPath, &encodePort);
+	int decodeServerProcessId = startServer(decodeServerPath, &decodePort);
+	int secondEncodeServerProcessId = startServer(encodeServerPath, &secondEncodePort);
+
+	checkStreams(encodePort, decodePort);
+	checkFullUnixQueue(encodeServerPath);
+	checkBatches(encodePort);
+	checkPrograms(programDirectory, encodePort, secondEncodePort);
+	checkManifestOffsets(programDirectory, encodePort);
+	checkDrain(encodeServerPath);
+	checkRestart(encodeServerPath);
+
+	stopServer(encodeServerProcessId);
+	stopServer(decodeServerProcessId);
+	stopServer(secondEncodeServerProcessId);
+
+	if(failureCount > 0){
+		fprintf(stderr, "%d checks failed\n", failureCount);
+		return 1;
+	}
+	printf("all checks passed\n");
+	return 0;
+}
@@ -0,0 +1,659 @@
+/*
+ * Asynchronous one time pad client library
+ * every connection is a small state machine driven by poll()
+ * requests are pipelined, so header, key and message are sent without waiting for
+ * the server's ok messages, and connections are kept open for the next request
+ * short text requests waiting in the queue are sent together as one batch
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/un.h>
+
+#include "otp_client.h"
+//for headers and limits shared with servers
+#include "otp_protocol.h"
+
+//not every system can turn off SIGPIPE per call, but those that can't will still report the error
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+//extra room in read buffer besides the result, for ok messages
+#define READ_BUFFER_EXTRA_SIZE 64
+
+//text requests this long or shorter are sent together in one batch when several of them are queued
+//since for short messages, each request's round trip costs much more than the transform
+#define BATCH_MAX_REQUEST_LENGTH 1024
+
+//largest number of requests sent in one batch
+//keeps the keys and messages of a batch well inside the server's buffer size
+#define BATCH_MAX_REQUEST_COUNT 64
+
+//number of times connecting to a unix domain socket with a full listen queue is tried again
+//waiting twice as long before each try, starting at UNIX_CONNECT_RETRY_START_MICROSECONDS
+//unix domain sockets refuse to wait in a full queue, so without this a busy local server fails requests that tcp would queue
+#define UNIX_CONNECT_RETRY_COUNT 7
+#define UNIX_CONNECT_RETRY_START_MICROSECONDS 1000
+
+//states of connections in pool
+//not connected to server
+#define CONNECTION_CLOSED 0
+//waiting for connection to server to be established
+#define CONNECTION_CONNECTING 1
+//connected to server, but not being used for a request
+#define CONNECTION_IDLE 2
+//sending request to server
+#define CONNECTION_SENDING 3
+//waiting for result from server
+#define CONNECTION_RECEIVING 4
+
+//request that was submitted, but hasn't finished
+typedef struct OtpClientRequest{
+  int requestType;
+  const char *message;
+  const char *key;
+  size_t length;
+  OtpClientCallback callback;
+  void *userData;
+  //set when request is sent again because a reused connection turned out to be closed by the server
+  int isRetry;
+  struct OtpClientRequest *next;
+} OtpClientRequest;
+
+//one connection to a server
+typedef struct OtpClientConnection{
+  //tcp or unix domain socket address
+  struct sockaddr_storage serverAddress;
+  socklen_t serverAddressLength;
+  int fileDescriptor;
+  int state;
+  //set after connection completes a request, since the server might close it before it is used again
+  int isReused;
+  //request being sent or received on this connection, or NULL if connection isn't being used
+  //for batches, the rest of the batch's requests follow it in order
+  OtpClientRequest *request;
+  //first message of request, which says what kind of request it is
+  char header[HEADER_BUFFER_SIZE];
+  //parts of request that haven't been sent yet start at vectors[vectorIndex]
+  struct iovec vectors[4 * BATCH_MAX_REQUEST_COUNT + 1];
+  int vectorIndex;
+  int vectorCount;
+  //data received from server
+  char *readBuffer;
+  size_t readBufferSize;
+  size_t readFill;
+  //index in readBuffer of first data that hasn't been parsed yet
+  size_t parsePosition;
+  //number of ok messages from server that come before the result
+  int okMessagesRemaining;
+} OtpClientConnection;
+
+struct OtpClientPool{
+  OtpClientConnection *connections;
+  int connectionCount;
+  //index of connection checked first for the next request, so requests are spread across endpoints
+  int nextConnection;
+  //requests waiting for a free connection
+  OtpClientRequest *queueHead;
+  OtpClientRequest *queueTail;
+  //requests submitted that haven't had their callbacks called yet
+  int unfinishedCount;
+  //used by otpClientPoll, with index of connection for each file descriptor
+  struct pollfd *pollFileDescriptors;
+  int *pollConnectionIndexes;
+};
+
+static void dispatchQueuedRequests(OtpClientPool *pool);
+
+/*
+ * Request queue functions
+ */
+//adds request to end of queue
+static void appendToQueue(OtpClientPool *pool, OtpClientRequest *request){
+  request->next = NULL;
+  if(pool->queueTail == NULL){
+    pool->queueHead = request;
+  }
+  else{
+    pool->queueTail->next = request;
+  }
+  pool->queueTail = request;
+}
+
+//adds request to front of queue, so it is sent next
+static void prependToQueue(OtpClientPool *pool, OtpClientRequest *request){
+  request->next = pool->queueHead;
+  pool->queueHead = request;
+  if(pool->queueTail == NULL){
+    pool->queueTail = request;
+  }
+}
+
+//removes and returns first request in queue, or NULL if queue is empty
+static OtpClientRequest * takeFromQueue(OtpClientPool *pool){
+  OtpClientRequest *request = pool->queueHead;
+  if(request != NULL){
+    pool->queueHead = request->next;
+    if(pool->queueHead == NULL){
+      pool->queueTail = NULL;
+    }
+  }
+  return request;
+}
+
+/*
+ * Connection functions
+ */
+//closes connection's socket, but keeps its buffers for the next time it is used
+static void closeConnection(OtpClientConnection *connection){
+  if(connection->fileDescriptor >= 0){
+    close(connection->fileDescriptor);
+  }
+  connection->fileDescriptor = -1;
+  connection->state = CONNECTION_CLOSED;
+  connection->isReused = 0;
+}
+
+//calls request's callback and frees it
+static void completeRequest(OtpClientPool *pool, OtpClientRequest *request, int status, const char *result, size_t resultLength){
+  pool->unfinishedCount--;
+  request->callback(status, result, resultLength, request->userData);
+  free(request);
+}
+
+//removes first request from connection, calls its callback and starts queued requests
+//connection state should be set before the last request of a batch is finished, since callback can submit new requests
+static void finishRequest(OtpClientPool *pool, OtpClientConnection *connection, int status, const char *result, size_t resultLength){
+  OtpClientRequest *request = connection->request;
+  connection->request = request->next;
+  completeRequest(pool, request, status, result, resultLength);
+  dispatchQueuedRequests(pool);
+}
+
+//removes all requests from connection and calls their callbacks with the same result, then starts queued requests
+//requests are removed first, so callbacks can start new requests on the connection
+static void finishAllRequests(OtpClientPool *pool, OtpClientConnection *connection, int status, const char *result, size_t resultLength){
+  OtpClientRequest *request = connection->request;
+  connection->request = NULL;
+  while(request != NULL){
+    OtpClientRequest *nextRequest = request->next;
+    completeRequest(pool, request, status, result, resultLength);
+    request = nextRequest;
+  }
+  dispatchQueuedRequests(pool);
+}
+
+//closes connection after an error, and either retries or fails its requests
+static void failConnection(OtpClientPool *pool, OtpClientConnection *connection){
+  //server may have closed a reused connection while it was idle, so if nothing was received try once more
+  int canRetry = connection->isReused && connection->readFill == 0;
+  OtpClientRequest *request;
+  for(request = connection->request; request != NULL; request = request->next){
+    canRetry = canRetry && !request->isRetry;
+  }
+  closeConnection(connection);
+  if(connection->request == NULL){
+    return;
+  }
+  if(canRetry){
+    //requests are put back in reverse, so they keep their order at the front of the queue
+    while(connection->request != NULL){
+      OtpClientRequest *lastRequest = connection->request;
+      OtpClientRequest *previousRequest = NULL;
+      while(lastRequest->next != NULL){
+        previousRequest = lastRequest;
+        lastRequest = lastRequest->next;
+      }
+      if(previousRequest == NULL){
+        connection->request = NULL;
+      }
+      else{
+        previousRequest->next = NULL;
+      }
+      lastRequest->isRetry = 1;
+      prependToQueue(pool, lastRequest);
+    }
+    dispatchQueuedRequests(pool);
+    return;
+  }
+  finishAllRequests(pool, connection, OTP_CLIENT_ERROR_CONNECTION, NULL, 0);
+}
+
+//starts connecting to server without waiting for connection to be established
+//returns 0 on success or -1 on failure
+static int openConnection(OtpClientConnection *connection){
+  int retryCount = 0;
+  while(1){
+    int fileDescriptor = socket(connection->serverAddress.ss_family, SOCK_STREAM, 0);
+    if(fileDescriptor < 0){
+      return -1;
+    }
+    //requests are small and sent all at once, so don't wait to fill packets
+    if(connection->serverAddress.ss_family == AF_INET){
+      int optval = 1;
+      setsockopt(fileDescriptor, IPPROTO_TCP, TCP_NODELAY, (const void *)&optval, sizeof(int));
+    }
+    if(fcntl(fileDescriptor, F_SETFL, fcntl(fileDescriptor, F_GETFL, 0) | O_NONBLOCK) < 0){
+      close(fileDescriptor);
+      return -1;
+    }
+    connection->fileDescriptor = fileDescriptor;
+    if(connect(fileDescriptor, (struct sockaddr *) &connection->serverAddress, connection->serverAddressLength) == 0){
+      connection->state = CONNECTION_SENDING;
+      return 0;
+    }
+    if(errno == EINPROGRESS){
+      connection->state = CONNECTION_CONNECTING;
+      return 0;
+    }
+    //unix domain sockets report a full listen queue as EAGAIN instead of waiting, and the socket isn't connecting,
+    //so it is closed and a new one is tried after waiting for the server to accept some connections
+    int isQueueFull = errno == EAGAIN && connection->serverAddress.ss_family == AF_UNIX;
+    closeConnection(connection);
+    if(!isQueueFull || retryCount == UNIX_CONNECT_RETRY_COUNT){
+      return -1;
+    }
+    usleep(UNIX_CONNECT_RETRY_START_MICROSECONDS << retryCount);
+    retryCount++;
+  }
+}
+
+//returns 1 if request can be sent as part of a batch with other requests of requestType, otherwise 0
+static int isBatchable(OtpClientRequest *request, int requestType){
+  return request != NULL && request->requestType == requestType && request->requestType != OTP_CLIENT_XOR && request->length <= BATCH_MAX_REQUEST_LENGTH;
+}
+
+//sets up connection to send request, and connects to server if necessary
+//short text requests queued right after request are sent with it as a batch
+static void startRequest(OtpClientPool *pool, OtpClientConnection *connection, OtpClientRequest *request){
+  connection->request = request;
+  request->next = NULL;
+  connection->readFill = 0;
+  connection->parsePosition = 0;
+
+  //whole request is sent at once, since server reads each part only after sending ok message
+  //results are the same length as messages, so make room for all of them at once
+  size_t neededReadBufferSize = request->length + READ_BUFFER_EXTRA_SIZE;
+  if(isBatchable(request, request->requestType) && isBatchable(pool->queueHead, request->requestType)){
+    connection->vectorCount = 1;
+    OtpClientRequest *lastRequest = request;
+    int requestCount = 0;
+    while(1){
+      connection->vectors[connection->vectorCount++] = (struct iovec){(void *)lastRequest->key, lastRequest->length};
+      connection->vectors[connection->vectorCount++] = (struct iovec){"\n", 1};
+      connection->vectors[connection->vectorCount++] = (struct iovec){(void *)lastRequest->message, lastRequest->length};
+      connection->vectors[connection->vectorCount++] = (struct iovec){"\n", 1};
+      neededReadBufferSize += lastRequest->length + 1;
+      requestCount++;
+      if(requestCount == BATCH_MAX_REQUEST_COUNT || !isBatchable(pool->queueHead, request->requestType)){
+        break;
+      }
+      lastRequest->next = takeFromQueue(pool);
+      lastRequest = lastRequest->next;
+      lastRequest->next = NULL;
+    }
+    snprintf(connection->header, HEADER_BUFFER_SIZE, "%s" BATCH_MESSAGE_HEADER_SUFFIX "%d\n", request->requestType == OTP_CLIENT_ENCODE ? ENCODE_REQUEST_NAME : DECODE_REQUEST_NAME, requestCount);
+    connection->vectors[0] = (struct iovec){connection->header, strlen(connection->header)};
+    connection->okMessagesRemaining = 1;
+  }
+  else if(request->requestType == OTP_CLIENT_XOR){
+    snprintf(connection->header, HEADER_BUFFER_SIZE, XOR_MESSAGE_HEADER_PREFIX "%lu\n", (unsigned long)request->length);
+    connection->vectors[0] = (struct iovec){connection->header, strlen(connection->header)};
+    connection->vectors[1] = (struct iovec){(void *)request->key, request->length};
+    connection->vectors[2] = (struct iovec){(void *)request->message, request->length};
+    connection->vectorCount = 3;
+    connection->okMessagesRemaining = 1;
+  }
+  else{
+    strcpy(connection->header, request->requestType == OTP_CLIENT_ENCODE ? ENCODE_MESSAGE_HEADER : DECODE_MESSAGE_HEADER);
+    connection->vectors[0] = (struct iovec){connection->header, strlen(connection->header)};
+    connection->vectors[1] = (struct iovec){(void *)request->key, request->length};
+    connection->vectors[2] = (struct iovec){"\n", 1};
+    connection->vectors[3] = (struct iovec){(void *)request->message, request->length};
+    connection->vectors[4] = (struct iovec){"\n", 1};
+    connection->vectorCount = 5;
+    connection->okMessagesRemaining = 2;
+  }
+  connection->vectorIndex = 0;
+
+  if(connection->readBufferSize < neededReadBufferSize){
+    char *readBuffer = realloc(connection->readBuffer, neededReadBufferSize);
+    if(readBuffer == NULL){
+      closeConnection(connection);
+      finishAllRequests(pool, connection, OTP_CLIENT_ERROR_CONNECTION, NULL, 0);
+      return;
+    }
+    connection->readBuffer = readBuffer;
+    connection->readBufferSize = neededReadBufferSize;
+  }
+
+  if(connection->state == CONNECTION_IDLE){
+    connection->state = CONNECTION_SENDING;
+  }
+  else if(openConnection(connection) < 0){
+    finishAllRequests(pool, connection, OTP_CLIENT_ERROR_CONNECTION, NULL, 0);
+  }
+}
+
+//starts queued requests on connections that aren't being used
+static void dispatchQueuedRequests(OtpClientPool *pool){
+  int connectionsChecked = 0;
+  while(pool->queueHead != NULL && connectionsChecked < pool->connectionCount){
+    OtpClientConnection *connection = &pool->connections[pool->nextConnection];
+    pool->nextConnection = (pool->nextConnection + 1) % pool->connectionCount;
+    connectionsChecked++;
+    if(connection->request != NULL || (connection->state != CONNECTION_IDLE && connection->state != CONNECTION_CLOSED)){
+      continue;
+    }
+    startRequest(pool, connection, takeFromQueue(pool));
+    connectionsChecked = 0;
+  }
+}
+
+//sends as much of request as socket will take
+static void sendRequest(OtpClientPool *pool, OtpClientConnection *connection){
+  while(connection->vectorIndex < connection->vectorCount){
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = connection->vectors + connection->vectorIndex;
+    message.msg_iovlen = connection->vectorCount - connection->vectorIndex;
+    //MSG_NOSIGNAL, so a closed connection is an error instead of killing the program
+    ssize_t charCountTransferred = sendmsg(connection->fileDescriptor, &message, MSG_NOSIGNAL);
+    if(charCountTransferred < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      if(errno != EAGAIN && errno != EWOULDBLOCK){
+        failConnection(pool, connection);
+      }
+      return;
+    }
+    //skip parts that were sent completely, and move start of partially sent part
+    while(connection->vectorIndex < connection->vectorCount && (size_t)charCountTransferred >= connection->vectors[connection->vectorIndex].iov_len){
+      charCountTransferred -= connection->vectors[connection->vectorIndex].iov_len;
+      connection->vectorIndex++;
+    }
+    if(connection->vectorIndex < connection->vectorCount){
+      struct iovec *vector = &connection->vectors[connection->vectorIndex];
+      vector->iov_base = (char *)vector->iov_base + charCountTransferred;
+      vector->iov_len -= charCountTransferred;
+    }
+  }
+  connection->state = CONNECTION_RECEIVING;
+}
+
+//checks received data for ok messages and result, and finishes request when result is complete
+static void parseResponse(OtpClientPool *pool, OtpClientConnection *connection){
+  while(1){
+    //request changes as each result of a batch is finished
+    OtpClientRequest *request = connection->request;
+    char *unparsedData = connection->readBuffer + connection->parsePosition;
+    size_t unparsedLength = connection->readFill - connection->parsePosition;
+    //xor results aren't terminated, so they are complete once all bytes are received
+    if(connection->okMessagesRemaining == 0 && request->requestType == OTP_CLIENT_XOR){
+      if(unparsedLength < request->length){
+        return;
+      }
+      connection->state = CONNECTION_IDLE;
+      connection->isReused = 1;
+      finishRequest(pool, connection, OTP_CLIENT_OK, unparsedData, request->length);
+      return;
+    }
+    char *terminator = memchr(unparsedData, DATA_TERMINATING_CHAR, unparsedLength);
+    if(terminator == NULL){
+      return;
+    }
+    size_t lineLength = terminator - unparsedData;
+    connection->parsePosition += lineLength + 1;
+
+    if(connection->okMessagesRemaining > 0){
+      //lines are compared without their terminator
+      if(lineLength == strlen(OK_MESSAGE) - 1 && memcmp(unparsedData, OK_MESSAGE, lineLength) == 0){
+        connection->okMessagesRemaining--;
+        continue;
+      }
+      //server refused request, and rest of request might not have been read, so connection can't be used again
+      closeConnection(connection);
+      finishAllRequests(pool, connection, OTP_CLIENT_ERROR_SERVER, unparsedData, lineLength);
+      return;
+    }
+    //whole request was read by server, so connection can be used again even if there was an error
+    //batch results come one line per request, and the connection is free once the last one arrives
+    int isLastResult = connection->request->next == NULL;
+    if(isLastResult){
+      connection->state = CONNECTION_IDLE;
+      connection->isReused = 1;
+    }
+    int status = lineLength > 0 && unparsedData[0] == SERVER_ERROR_CHAR ? OTP_CLIENT_ERROR_SERVER : OTP_CLIENT_OK;
+    finishRequest(pool, connection, status, unparsedData, lineLength);
+    if(isLastResult){
+      return;
+    }
+  }
+}
+
+//reads available data from server into connection's read buffer
+static void receiveResponse(OtpClientPool *pool, OtpClientConnection *connection){
+  //more than expected was received, so make more room
+  if(connection->readFill == connection->readBufferSize){
+    char *readBuffer = realloc(connection->readBuffer, connection->readBufferSize * 2);
+    if(readBuffer == NULL){
+      failConnection(pool, connection);
+      return;
+    }
+    connection->readBuffer = readBuffer;
+    connection->readBufferSize *= 2;
+  }
+  ssize_t charCountTransferred = read(connection->fileDescriptor, connection->readBuffer + connection->readFill, connection->readBufferSize - connection->readFill);
+  if(charCountTransferred < 0){
+    if(errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK){
+      failConnection(pool, connection);
+    }
+    return;
+  }
+  //server closed connection before result was complete
+  if(charCountTransferred == 0){
+    failConnection(pool, connection);
+    return;
+  }
+  connection->readFill += charCountTransferred;
+  parseResponse(pool, connection);
+}
+
+//checks whether non-blocking connect succeeded, and starts sending request if it did
+static void finishConnecting(OtpClientPool *pool, OtpClientConnection *connection){
+  int connectError = 0;
+  socklen_t connectErrorLength = sizeof(connectError);
+  if(getsockopt(connection->fileDescriptor, SOL_SOCKET, SO_ERROR, &connectError, &connectErrorLength) < 0 || connectError != 0){
+    failConnection(pool, connection);
+    return;
+  }
+  connection->state = CONNECTION_SENDING;
+  sendRequest(pool, connection);
+}
+
+
+/*
+ * Public functions
+ */
+//sets connection's server address from endpoint
+//returns 0 on success, or -1 if endpoint is invalid
+static int setServerAddress(OtpClientConnection *connection, const OtpClientEndpoint *endpoint){
+  memset(&connection->serverAddress, 0, sizeof(connection->serverAddress));
+  if(endpoint->unixSocketPath != NULL){
+    struct sockaddr_un *unixAddress = (struct sockaddr_un *) &connection->serverAddress;
+    if(strlen(endpoint->unixSocketPath) >= sizeof(unixAddress->sun_path)){
+      return -1;
+    }
+    unixAddress->sun_family = AF_UNIX;
+    strcpy(unixAddress->sun_path, endpoint->unixSocketPath);
+    connection->serverAddressLength = sizeof(struct sockaddr_un);
+    return 0;
+  }
+  struct sockaddr_in *tcpAddress = (struct sockaddr_in *) &connection->serverAddress;
+  tcpAddress->sin_family = AF_INET;
+  tcpAddress->sin_port = htons((unsigned short)endpoint->port);
+  //use system's ip address when no host is given, the same as the command-line clients
+  tcpAddress->sin_addr.s_addr = htonl(INADDR_ANY);
+  connection->serverAddressLength = sizeof(struct sockaddr_in);
+  if(endpoint->port <= 0 || endpoint->port > 65535 || (endpoint->host != NULL && inet_pton(AF_INET, endpoint->host, &tcpAddress->sin_addr) != 1)){
+    return -1;
+  }
+  return 0;
+}
+
+//creates pool with connectionsPerEndpoint connections to every endpoint
+//returns NULL if memory could not be allocated or arguments are invalid
+OtpClientPool * otpClientPoolCreate(const OtpClientEndpoint *endpoints, int endpointCount, int connectionsPerEndpoint){
+  if(endpointCount <= 0 || connectionsPerEndpoint <= 0){
+    return NULL;
+  }
+  OtpClientPool *pool = calloc(1, sizeof(OtpClientPool));
+  if(pool == NULL){
+    return NULL;
+  }
+  pool->connectionCount = endpointCount * connectionsPerEndpoint;
+  pool->connections = calloc(pool->connectionCount, sizeof(OtpClientConnection));
+  pool->pollFileDescriptors = calloc(pool->connectionCount, sizeof(struct pollfd));
+  pool->pollConnectionIndexes = calloc(pool->connectionCount, sizeof(int));
+  if(pool->connections == NULL || pool->pollFileDescriptors == NULL || pool->pollConnectionIndexes == NULL){
+    otpClientPoolDestroy(pool);
+    return NULL;
+  }
+  //connections alternate between endpoints, so consecutive requests go to different servers
+  int i;
+  for(i = 0; i < pool->connectionCount; ++i){
+    OtpClientConnection *connection = &pool->connections[i];
+    const OtpClientEndpoint *endpoint = &endpoints[i % endpointCount];
+    connection->fileDescriptor = -1;
+    connection->state = CONNECTION_CLOSED;
+    if(setServerAddress(connection, endpoint) < 0){
+      otpClientPoolDestroy(pool);
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+//closes all connections and frees pool
+//callbacks for requests that haven't finished are called with OTP_CLIENT_ERROR_CONNECTION
+void otpClientPoolDestroy(OtpClientPool *pool){
+  if(pool == NULL){
+    return;
+  }
+  //queued requests are failed first, so callbacks can't start them on a connection
+  OtpClientRequest *request;
+  while((request = takeFromQueue(pool)) != NULL){
+    request->callback(OTP_CLIENT_ERROR_CONNECTION, NULL, 0, request->userData);
+    free(request);
+  }
+  int i;
+  for(i = 0; pool->connections != NULL && i < pool->connectionCount; ++i){
+    OtpClientConnection *connection = &pool->connections[i];
+    closeConnection(connection);
+    while((request = connection->request) != NULL){
+      connection->request = request->next;
+      request->callback(OTP_CLIENT_ERROR_CONNECTION, NULL, 0, request->userData);
+      free(request);
+    }
+    free(connection->readBuffer);
+  }
+  free(pool->connections);
+  free(pool->pollFileDescriptors);
+  free(pool->pollConnectionIndexes);
+  free(pool);
+}
+
+//queues request to combine length characters of message and key, and starts sending it if a connection is free
+//returns 0 if request was queued, or -1 if text message or key contain a newline character
+int otpClientSubmit(OtpClientPool *pool, int requestType, const char *message, const char *key, size_t length, OtpClientCallback callback, void *userData){
+  //newlines in text would end key or message early
+  if(requestType != OTP_CLIENT_XOR && (memchr(message, DATA_TERMINATING_CHAR, length) != NULL || memchr(key, DATA_TERMINATING_CHAR, length) != NULL)){
+    return -1;
+  }
+  OtpClientRequest *request = malloc(sizeof(OtpClientRequest));
+  if(request == NULL){
+    return -1;
+  }
+  request->requestType = requestType;
+  request->message = message;
+  request->key = key;
+  request->length = length;
+  request->callback = callback;
+  request->userData = userData;
+  request->isRetry = 0;
+  pool->unfinishedCount++;
+  appendToQueue(pool, request);
+  dispatchQueuedRequests(pool);
+  return 0;
+}
+
+//sends and receives data on connections that are ready, and calls callbacks for requests that finish
+//returns number of requests that haven't finished yet, or -1 if waiting failed
+int otpClientPoll(OtpClientPool *pool, int timeoutMilliseconds){
+  //only connections with requests need to be checked
+  int pollCount = 0;
+  int i;
+  for(i = 0; i < pool->connectionCount; ++i){
+    OtpClientConnection *connection = &pool->connections[i];
+    if(connection->request == NULL || connection->fileDescriptor < 0){
+      continue;
+    }
+    pool->pollFileDescriptors[pollCount].fd = connection->fileDescriptor;
+    pool->pollFileDescriptors[pollCount].events = connection->state == CONNECTION_RECEIVING ? POLLIN : POLLOUT;
+    pool->pollFileDescriptors[pollCount].revents = 0;
+    pool->pollConnectionIndexes[pollCount] = i;
+    pollCount++;
+  }
+  if(pollCount == 0){
+    return pool->unfinishedCount;
+  }
+
+  int readyCount = poll(pool->pollFileDescriptors, pollCount, timeoutMilliseconds);
+  if(readyCount < 0){
+    return errno == EINTR ? pool->unfinishedCount : -1;
+  }
+  for(i = 0; i < pollCount && readyCount > 0; ++i){
+    struct pollfd *pollFileDescriptor = &pool->pollFileDescriptors[i];
+    OtpClientConnection *connection = &pool->connections[pool->pollConnectionIndexes[i]];
+    //callbacks of earlier connections may have already closed or reused this one
+    if(pollFileDescriptor->revents == 0 || connection->fileDescriptor != pollFileDescriptor->fd || connection->request == NULL){
+      continue;
+    }
+    readyCount--;
+    switch(connection->state){
+      case CONNECTION_CONNECTING:
+        finishConnecting(pool, connection);
+        break;
+      case CONNECTION_SENDING:
+        sendRequest(pool, connection);
+        break;
+      case CONNECTION_RECEIVING:
+        receiveResponse(pool, connection);
+        break;
+    }
+  }
+  return pool->unfinishedCount;
+}
+
+//calls otpClientPoll until all submitted requests have finished
+//returns 0 on success, or -1 if waiting failed
+int otpClientWaitAll(OtpClientPool *pool){
+  int unfinishedCount = pool->unfinishedCount;
+  while(unfinishedCount > 0){
+    unfinishedCount = otpClientPoll(pool, -1);
+  }
+  return unfinishedCount < 0 ? -1 : 0;
+}
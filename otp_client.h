@@ -0,0 +1,68 @@
+/*
+ * Asynchronous one time pad client library
+ * keeps a pool of persistent connections to one or more servers, so that many
+ * encode/decode requests can be in flight at the same time from a single thread
+ * requests are submitted with a callback, and callbacks are run from otpClientPoll()
+ * short text requests that are queued at the same time are sent to the server together as one batch
+ * link with libotp.a or libotp.so
+ */
+
+#ifndef OTP_CLIENT_H
+#define OTP_CLIENT_H
+
+#include <stddef.h>
+
+//kinds of requests that can be submitted
+//encode and decode requests must be sent to otp_enc_d and otp_dec_d servers respectively
+//xor requests can be sent to either
+#define OTP_CLIENT_ENCODE 0
+#define OTP_CLIENT_DECODE 1
+#define OTP_CLIENT_XOR 2
+
+//status given to request callbacks
+//request succeeded and result contains encoded or decoded message
+#define OTP_CLIENT_OK 0
+//could not connect to server, or connection was lost
+#define OTP_CLIENT_ERROR_CONNECTION -1
+//server refused request, and result contains error message from server
+#define OTP_CLIENT_ERROR_SERVER -2
+
+//server to send requests to
+typedef struct OtpClientEndpoint{
+  //IPv4 address in dotted decimal notation, or NULL for this computer
+  const char *host;
+  int port;
+  //path of server's unix domain socket, used instead of host and port when not NULL
+  const char *unixSocketPath;
+} OtpClientEndpoint;
+
+//called once for every submitted request when it finishes
+//result is only valid until the callback returns, and is not null terminated
+typedef void (*OtpClientCallback)(int status, const char *result, size_t resultLength, void *userData);
+
+typedef struct OtpClientPool OtpClientPool;
+
+//creates pool with connectionsPerEndpoint connections to every endpoint
+//connections are opened the first time they are needed, and kept open afterwards
+//returns NULL if memory could not be allocated or arguments are invalid
+OtpClientPool * otpClientPoolCreate(const OtpClientEndpoint *endpoints, int endpointCount, int connectionsPerEndpoint);
+
+//closes all connections and frees pool
+//callbacks for requests that haven't finished are called with OTP_CLIENT_ERROR_CONNECTION
+void otpClientPoolDestroy(OtpClientPool *pool);
+
+//queues request to combine length characters of message and key, and starts sending it if a connection is free
+//message and key are not copied, so they must not be changed or freed until callback is called
+//returns 0 if request was queued, or -1 if text message or key contain a newline character
+int otpClientSubmit(OtpClientPool *pool, int requestType, const char *message, const char *key, size_t length, OtpClientCallback callback, void *userData);
+
+//sends and receives data on connections that are ready, waiting up to timeoutMilliseconds
+//(-1 to wait until something happens) and calls callbacks for requests that finish
+//returns number of requests that haven't finished yet, or -1 if waiting failed
+int otpClientPoll(OtpClientPool *pool, int timeoutMilliseconds);
+
+//calls otpClientPoll until all submitted requests have finished
+//returns 0 on success, or -1 if waiting failed
+int otpClientWaitAll(OtpClientPool *pool);
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * Fast built-in compression for plaintext sent between clients and servers
+ * compressed data is a series of sequences, each made up of:
+ * a token byte with the number of literals in the high 4 bits and match length - 4 in the low 4 bits,
+ * extra literal count bytes if the count is 15 or more, the literals,
+ * the match offset as 2 bytes, least significant first, and extra match length bytes if it is 19 or more
+ * extra count bytes are added to the count, and continue while they are 255
+ * the last sequence only has literals, and ends at the end of the compressed data
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "otp_compress.h"
+
+//shortest match that is stored as a match instead of literals
+#define MIN_MATCH_LENGTH 4
+
+//matches can only refer this many bytes back, since offsets are stored in 2 bytes
+#define MAX_MATCH_OFFSET 65535
+
+//count stored in 4 bits of token, which means extra count bytes follow
+#define TOKEN_COUNT_MAX 15
+
+//number of bits of hash of 4 bytes of input used to find earlier matches
+#define HASH_BITS 12
+
+//returns hash of 4 bytes at data, used as index in table of earlier positions
+static uint32_t hashSequence(const char *data){
+  uint32_t sequence;
+  memcpy(&sequence, data, sizeof(sequence));
+  return (sequence * 2654435761u) >> (32 - HASH_BITS);
+}
+
+//writes count that didn't fit in token as extra count bytes
+//returns next output position, or NULL if output is full
+static char * writeExtraCount(char *outputPosition, char *outputEnd, size_t count){
+  for(; count >= 255; count -= 255){
+    if(outputPosition == outputEnd){
+      return NULL;
+    }
+    *outputPosition++ = (char)255;
+  }
+  if(outputPosition == outputEnd){
+    return NULL;
+  }
+  *outputPosition++ = (char)count;
+  return outputPosition;
+}
+
+//writes one sequence of literalCount literals followed by match, or only literals if matchLength is 0
+//returns next output position, or NULL if output is full
+static char * writeSequence(char *outputPosition, char *outputEnd, const char *literals, size_t literalCount, size_t matchOffset, size_t matchLength){
+  if(outputPosition == outputEnd){
+    return NULL;
+  }
+  char *token = outputPosition++;
+  size_t matchCount = matchLength > 0 ? matchLength - MIN_MATCH_LENGTH : 0;
+  *token = (char)(((literalCount < TOKEN_COUNT_MAX ? literalCount : TOKEN_COUNT_MAX) << 4) | (matchCount < TOKEN_COUNT_MAX ? matchCount : TOKEN_COUNT_MAX));
+  if(literalCount >= TOKEN_COUNT_MAX && (outputPosition = writeExtraCount(outputPosition, outputEnd, literalCount - TOKEN_COUNT_MAX)) == NULL){
+    return NULL;
+  }
+  if((size_t)(outputEnd - outputPosition) < literalCount){
+    return NULL;
+  }
+  memcpy(outputPosition, literals, literalCount);
+  outputPosition += literalCount;
+  if(matchLength == 0){
+    return outputPosition;
+  }
+  if(outputEnd - outputPosition < 2){
+    return NULL;
+  }
+  *outputPosition++ = (char)(matchOffset & 0xff);
+  *outputPosition++ = (char)(matchOffset >> 8);
+  if(matchCount >= TOKEN_COUNT_MAX){
+    return writeExtraCount(outputPosition, outputEnd, matchCount - TOKEN_COUNT_MAX);
+  }
+  return outputPosition;
+}
+
+//compresses length bytes of input into output, which can hold outputSize bytes
+//returns number of bytes stored in output, or 0 if compressed data doesn't fit
+size_t otpCompress(const char *input, size_t length, char *output, size_t outputSize){
+  //position + 1 of last place each hash was seen, so 0 means it hasn't been seen
+  uint32_t earlierPositions[1 << HASH_BITS];
+  memset(earlierPositions, 0, sizeof(earlierPositions));
+  char *outputPosition = output;
+  char *outputEnd = output + outputSize;
+  //start of input that hasn't been written yet
+  size_t literalStart = 0;
+  size_t position = 0;
+  while(position + MIN_MATCH_LENGTH <= length){
+    uint32_t hash = hashSequence(input + position);
+    size_t candidate = earlierPositions[hash];
+    earlierPositions[hash] = position + 1;
+    if(candidate == 0 || position - (candidate - 1) > MAX_MATCH_OFFSET || memcmp(input + candidate - 1, input + position, MIN_MATCH_LENGTH) != 0){
+      position++;
+      continue;
+    }
+    candidate--;
+    size_t matchLength = MIN_MATCH_LENGTH;
+    while(position + matchLength < length && input[candidate + matchLength] == input[position + matchLength]){
+      matchLength++;
+    }
+    outputPosition = writeSequence(outputPosition, outputEnd, input + literalStart, position - literalStart, position - candidate, matchLength);
+    if(outputPosition == NULL){
+      return 0;
+    }
+    position += matchLength;
+    literalStart = position;
+  }
+  outputPosition = writeSequence(outputPosition, outputEnd, input + literalStart, length - literalStart, 0, 0);
+  return outputPosition == NULL ? 0 : (size_t)(outputPosition - output);
+}
+
+//reads extra count bytes and adds them to count
+//returns next input position, or NULL if input ends before count does
+static const unsigned char * readExtraCount(const unsigned char *inputPosition, const unsigned char *inputEnd, size_t *count){
+  unsigned char countByte;
+  do{
+    if(inputPosition == inputEnd){
+      return NULL;
+    }
+    countByte = *inputPosition++;
+    *count += countByte;
+  }while(countByte == 255);
+  return inputPosition;
+}
+
+//decompresses inputLength bytes of data compressed by otpCompress into output, which can hold outputSize bytes
+//returns number of bytes stored in output, or -1 if input is invalid or doesn't fit in output
+long otpDecompress(const char *input, size_t inputLength, char *output, size_t outputSize){
+  const unsigned char *inputPosition = (const unsigned char *)input;
+  const unsigned char *inputEnd = inputPosition + inputLength;
+  size_t outputFill = 0;
+  while(inputPosition < inputEnd){
+    unsigned char token = *inputPosition++;
+    size_t literalCount = token >> 4;
+    if(literalCount == TOKEN_COUNT_MAX && (inputPosition = readExtraCount(inputPosition, inputEnd, &literalCount)) == NULL){
+      return -1;
+    }
+    if((size_t)(inputEnd - inputPosition) < literalCount || outputSize - outputFill < literalCount){
+      return -1;
+    }
+    memcpy(output + outputFill, inputPosition, literalCount);
+    inputPosition += literalCount;
+    outputFill += literalCount;
+    //last sequence has no match
+    if(inputPosition == inputEnd){
+      break;
+    }
+
+    if(inputEnd - inputPosition < 2){
+      return -1;
+    }
+    size_t matchOffset = inputPosition[0] | (inputPosition[1] << 8);
+    inputPosition += 2;
+    size_t matchLength = token & TOKEN_COUNT_MAX;
+    if(matchLength == TOKEN_COUNT_MAX && (inputPosition = readExtraCount(inputPosition, inputEnd, &matchLength)) == NULL){
+      return -1;
+    }
+    matchLength += MIN_MATCH_LENGTH;
+    if(matchOffset == 0 || matchOffset > outputFill || outputSize - outputFill < matchLength){
+      return -1;
+    }
+    //match can overlap the data being written, e.g. a run of one repeated character, so copy forwards one byte at a time
+    char *matchSource = output + outputFill - matchOffset;
+    char *matchDestination = output + outputFill;
+    if(matchOffset >= matchLength){
+      memcpy(matchDestination, matchSource, matchLength);
+    }
+    else{
+      size_t i;
+      for(i = 0; i < matchLength; ++i){
+        matchDestination[i] = matchSource[i];
+      }
+    }
+    outputFill += matchLength;
+  }
+  return outputFill;
+}
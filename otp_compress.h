@@ -0,0 +1,22 @@
+/*
+ * Fast built-in compression for plaintext sent between clients and servers
+ * LZ77 with byte-aligned sequences in the style of LZ4, so it is cheap enough to use on every chunk
+ * link with libotp.a or libotp.so
+ */
+
+#ifndef OTP_COMPRESS_H
+#define OTP_COMPRESS_H
+
+#include <stddef.h>
+
+//compresses length bytes of input into output, which can hold outputSize bytes
+//output size can be set smaller than length to only accept compression that saves space
+//returns number of bytes stored in output, or 0 if compressed data doesn't fit
+size_t otpCompress(const char *input, size_t length, char *output, size_t outputSize);
+
+//decompresses inputLength bytes of data compressed by otpCompress into output, which can hold outputSize bytes
+//input is checked, so data from the network can be decompressed safely
+//returns number of bytes stored in output, or -1 if input is invalid or doesn't fit in output
+long otpDecompress(const char *input, size_t inputLength, char *output, size_t outputSize);
+
+#endif
@@ -10,5 +10,9 @@
 //for the encode client
 
 //used in initial message to server to identify client
-#define CLIENT_IDENTIFICATION_HEADER "DECODE\n"
+#define CLIENT_IDENTIFICATION_HEADER DECODE_MESSAGE_HEADER
+//used by client library for requests in batch mode
+#define CLIENT_REQUEST_TYPE OTP_CLIENT_DECODE
+//results are plaintext, so they are compressed by the server in compressed stream mode
+#define IS_RESULT_PLAINTEXT 1
 #include "otp_enc.c"
\ No newline at end of file
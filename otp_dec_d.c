@@ -10,13 +10,14 @@
 */
 //string used to represent client is the correct one
 //should be sent as first message from client
-#define ACCEPTED_MESSAGE_HEADER "DECODE\n"
-//number of chars including null char in header
-#define ACCEPTED_MESSAGE_HEADER_LENGTH 8
+#define ACCEPTED_MESSAGE_HEADER DECODE_MESSAGE_HEADER
 
-//function used to combine plaintext character and key character to get
-//resulting character that server sends to the client
-#define CHARACTER_TRANSFORMATION_FUNCTION_POINTER &decodeCharacter 
+//function used to combine message and key to get
+//resulting message that server sends to the client
+#define MESSAGE_TRANSFORMATION_FUNCTION_POINTER &otpDecode
+
+//results are plaintext, so they are compressed in compressed stream mode
+#define IS_RESULT_PLAINTEXT 1
 
 //with the exception of the above constants, encoding and decoding server should work the same
 //so just include the code for the encoding server
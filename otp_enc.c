@@ -14,25 +14,44 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-//for character functions
-#include <ctype.h>
+//for unix domain sockets
+#include <sys/un.h>
+//for mapping shared memory
+#include <sys/mman.h>
+//for reading stdin and results at the same time in stream mode
+#include <poll.h>
 //for error checking
 #include <assert.h>
 //for file opening errors
 #include <errno.h>
-
-//maximum number of characters used for the buffer for messages sent to/from the client
-#define MESSAGE_BUFFER_SIZE 131071
+//for reading whole files
+#include <limits.h>
+//for buffered socket reading/writing
+#include "socket_io.h"
+//for validating message and key
+#include "otp.h"
+//for sending batches of requests over multiple connections
+#include "otp_client.h"
+//for compressed stream mode
+#include "otp_compress.h"
+//for headers and limits shared with servers
+#include "otp_protocol.h"
 
 //maximum number of requests that allowed to queue up waiting for server to become available
 #define REQUEST_QUEUE_SIZE 5
 
-//string used as ok message to client
-//so client knows it is ok to send
-#define OK_MESSAGE "@OK\n"
+//size of shared memory ring buffer used in shared memory mode
+//big enough that each chunk is at least the server's default PARALLEL_TRANSFORM_THRESHOLD, so it is transformed by multiple threads
+#define SHARED_MEMORY_RING_SIZE 33554432
+
+//largest number of chunks sent to server in stream mode before their results are received
+//so the server transforms one chunk while the next is read from stdin and sent
+//the results of all of them fit in the socket's receive buffer, so client and server never both wait to send
+#define STREAM_CHUNKS_IN_FLIGHT 2
 
-//character used to terminate cipher key and message strings
-#define DATA_TERMINATING_CHAR '\n'
+//number of slots in shared memory ring buffer, each holding one chunk of key followed by one chunk of message
+//server works on one slot while client fills the others
+#define SHARED_MEMORY_SLOT_COUNT 8
 
 
 /*
@@ -41,15 +60,54 @@
 //string used to identify client to server
 //should be sent as first message to server
 #ifndef CLIENT_IDENTIFICATION_HEADER
-#define CLIENT_IDENTIFICATION_HEADER "ENCODE\n"
+#define CLIENT_IDENTIFICATION_HEADER ENCODE_MESSAGE_HEADER
+#endif
+
+//kind of request sent by client library in batch mode
+#ifndef CLIENT_REQUEST_TYPE
+#define CLIENT_REQUEST_TYPE OTP_CLIENT_ENCODE
+#endif
+
+//1 if results received from server are plaintext, so messages aren't worth compressing in compressed stream mode
+#ifndef IS_RESULT_PLAINTEXT
+#define IS_RESULT_PLAINTEXT 0
 #endif
 
+//number of connections to server used in batch mode, unless -j option is given
+#define DEFAULT_BATCH_CONNECTION_COUNT 4
+
+//maximum number of servers that can be given as a comma-separated list of ports
+#define MAX_SERVER_COUNT 64
+
+//number of stripes sent to each server when a message is split across multiple servers
+//more than one, so a server that finishes early can take another stripe
+#define STRIPES_PER_SERVER 2
+
+//stripes are never shorter than this, since sending a short stripe costs more than transforming it
+#define MIN_STRIPE_LENGTH 4096
+
+//number of files loaded per connection in batch mode, so a connection
+//always has the next request ready without loading the whole manifest at once
+#define BATCH_REQUESTS_PER_CONNECTION 2
+
 /*
  * Error functions
  */
 //prints program usage
 void printUsage(char *programName){
-	fprintf(stderr, "usage: %s <plaintext_file> <key_file> <port>\n", programName);
+	fprintf(stderr, "usage: %s [-x] <plaintext_file> <key_file> <port>[,<port>...]\n", programName);
+	fprintf(stderr, "       %s [-x] -m <manifest_file> [-j <connections>] <port>[,<port>...]\n", programName);
+	fprintf(stderr, "       %s -s [-z] <key_file> <port> < <plaintext_file>\n", programName);
+	fprintf(stderr, "       %s -S <plaintext_file> <key_file> <unix_socket_path>\n", programName);
+	fprintf(stderr, "  -x  combine any bytes in files using exclusive or, instead of A-Z and space characters\n");
+	fprintf(stderr, "  -m  process every line of manifest file, which has the form\n");
+	fprintf(stderr, "      <plaintext_file> <key_file> <output_file> [<key_offset>]\n");
+	fprintf(stderr, "  -j  number of connections to server used for manifest (default %d)\n", DEFAULT_BATCH_CONNECTION_COUNT);
+	fprintf(stderr, "  -s  read message from stdin and write result to stdout as it is received\n");
+	fprintf(stderr, "  -z  in stream mode, compress plaintext sent to or received from server, if server supports it\n");
+	fprintf(stderr, "  -S  send message to server on the same computer through shared memory\n");
+	fprintf(stderr, "a path to a server's unix domain socket can be given in place of any port\n");
+	fprintf(stderr, "when more than one port is given, message is split into stripes that are sent to all servers at the same time\n");
 }
 
 
@@ -65,9 +123,9 @@ int isPortNumValid(int portNum){
 	return 0;
 }
 
-//Validates command-line arguments for correct number
-void validateCommandLineArgumentsLength(int argc, char **argv){
-	if(argc != 4){
+//Validates command-line arguments for correct number after options
+void validateCommandLineArgumentsLength(int argc, char **argv, int expectedLength){
+	if(argc - optind != expectedLength){
 		printUsage(argv[0]);
 		exit(1);
 	}
@@ -75,9 +133,9 @@ void validateCommandLineArgumentsLength(int argc, char **argv){
 }
 
 //validates port num argument is valid and returns it if it is
-int getPortNum(int argc, char **argv){
-	//get port number from command line arguments
-	int portNum = atoi(argv[3]);
+int getPortNum(char *portArgument){
+	//get port number from command line argument
+	int portNum = atoi(portArgument);
   	//check that portNum is valid - if atoi fails, 0 is returned
   	if(!isPortNumValid(portNum)){
     	fprintf(stderr, "Port given is out of valid range\n");
@@ -86,34 +144,50 @@ int getPortNum(int argc, char **argv){
   	return portNum;
 }
 
+//parses comma-separated list of ports into endpoints for client library
+//entries containing '/' are paths of unix domain sockets
+//returns number of endpoints
+int getEndpoints(char *portArgument, OtpClientEndpoint *endpoints){
+	int endpointCount = 0;
+	char *portString = strtok(portArgument, ",");
+	while(portString != NULL){
+		if(endpointCount == MAX_SERVER_COUNT){
+			fprintf(stderr, "No more than %d ports can be given\n", MAX_SERVER_COUNT);
+			exit(2);
+		}
+		endpoints[endpointCount].host = NULL;
+		endpoints[endpointCount].port = 0;
+		endpoints[endpointCount].unixSocketPath = NULL;
+		if(strchr(portString, '/') != NULL){
+			endpoints[endpointCount].unixSocketPath = portString;
+		}
+		else{
+			endpoints[endpointCount].port = getPortNum(portString);
+		}
+		endpointCount++;
+		portString = strtok(NULL, ",");
+	}
+	if(endpointCount == 0){
+		fprintf(stderr, "Port given is out of valid range\n");
+		exit(2);
+	}
+	return endpointCount;
+}
+
 /*
 * Get data from server functions
 */
 
 //allocates memory for string buffer to store one time pad or message
+//memory isn't cleared first, since reads from the server are null terminated
 char * createBuffer(int bufferSize){
   //allocate memory
   char *buffer = malloc(sizeof(char) * bufferSize);
   //check that memory allocation succeeded
   assert(buffer != NULL);
-  //initialize memory with null chars
-  bzero(buffer, bufferSize);
   return buffer;
 }
 
-//removes trailing '\n' char from string
-void chompString(char* message){
-  int length = strlen(message);
-  //check to make sure buffer has length first
-  if(length == 0){
-    return;
-  }
-  //remove trailing '\n' by changing it to null char
-  if(message[length - 1] == '\n'){
-    message[length - 1] = '\0';
-  }
-}
-
 
 
 
@@ -156,26 +230,78 @@ FILE * openFileByName(char *fileName){
 	return filePointer;
 }
 
+//reads up to maxLength bytes from the start of file into newly allocated buffer, and stores number of bytes read in fileLength
+//prints error message and returns NULL if file can't be opened or read
+char * loadFile(char *fileName, long *fileLength, long maxLength){
+	FILE *filePointer = fopen(fileName, "r");
+	if(filePointer == NULL){
+		printFileOpenError(errno, fileName);
+		return NULL;
+	}
+	char *buffer = NULL;
+	//find file size by seeking to the end
+	if(fseek(filePointer, 0, SEEK_END) == 0 && (*fileLength = ftell(filePointer)) >= 0){
+		rewind(filePointer);
+		if(*fileLength > maxLength){
+			*fileLength = maxLength;
+		}
+		//allocate at least one byte, so empty files still get a buffer
+		buffer = malloc(*fileLength + 1);
+		assert(buffer != NULL);
+		if(fread(buffer, sizeof(char), *fileLength, filePointer) != (size_t)*fileLength){
+			free(buffer);
+			buffer = NULL;
+		}
+	}
+	if(buffer == NULL){
+		fprintf(stderr, "Could not read %s\n", fileName);
+	}
+	fclose(filePointer);
+	return buffer;
+}
+
+//reads up to maxLength bytes from the start of file into newly allocated buffer, and stores number of bytes read in fileLength
+//exits with error if file can't be opened or read
+char * readFileStart(char *fileName, long *fileLength, long maxLength){
+	char *buffer = loadFile(fileName, fileLength, maxLength);
+	if(buffer == NULL){
+		exit(1);
+	}
+	return buffer;
+}
+
+//reads whole message or key file, removing trailing newline and validating characters unless in xor mode
+//returns NULL and prints error message if file is invalid
+char * loadMessageFile(char *fileName, long *fileLength, int isXorMode){
+	char *data = loadFile(fileName, fileLength, LONG_MAX);
+	if(data == NULL || isXorMode){
+		return data;
+	}
+	if(*fileLength > 0 && data[*fileLength - 1] == DATA_TERMINATING_CHAR){
+		(*fileLength)--;
+	}
+	if(!otpIsValidText(data, *fileLength)){
+		fprintf(stderr, "%s contains characters other than uppercase letters and spaces\n", fileName);
+		free(data);
+		return NULL;
+	}
+	return data;
+}
+
 //check line to see if it contains invalid characters 
 //(anything except uppercase characters or spaces)
 //returns 1 if it doesn't, 0 if it does
-int isValidLine(char *line){
-	//subtract 1 from length, since last character will be newline
-	int length = strlen(line) - 1;
-	int i;
-	for(i=0;i<length;i++){
-		char currentChar = line[i];
-		//make sure character is either uppercase letter or space
-		if(!isupper(currentChar) && currentChar != ' '){
-			return 0;
-		}
+int isValidLine(char *line, int lineLength){
+	//last character will be newline, so don't check it
+	if(lineLength > 0 && line[lineLength - 1] == DATA_TERMINATING_CHAR){
+		lineLength--;
 	}
-	return 1;
-
+	//make sure every character is either uppercase letter or space
+	return otpIsValidText(line, lineLength);
 }
 
 //reads file line by line
-//returns number of characters in first line if file contains only valid characters
+//returns number of characters in first line, not counting its newline, if file contains only valid characters
 //or 0 otherwise
 //note that file should only contain exactly one line (text file automatically contain extra newline at end of file)
 int isFileContentsValid(char *fileName){
@@ -194,12 +320,12 @@ int isFileContentsValid(char *fileName){
 			break;
 		}
 		//check to see if line contains invalid characters
-		else if(linesRead > 0 || !isValidLine(line)){
+		else if(linesRead > 0 || !isValidLine(line, read)){
 			returnValue = 0;
 			break;
 		}
 		else{
-			returnValue = strlen(line);
+			returnValue = line[read - 1] == DATA_TERMINATING_CHAR ? read - 1 : read;
 		}
 		linesRead++;
 	}
@@ -214,7 +340,7 @@ int isFileContentsValid(char *fileName){
 //message and exits if it doesn't
 int checkFileContents(char *fileName){
 	int length = isFileContentsValid(fileName);
-	if(!isFileContentsValid(fileName)){
+	if(!length){
 		fprintf(stderr, "%s contains characters other than uppercase letters and spaces or is empty\n", fileName);
 		exit(1);
 	}
@@ -262,67 +388,74 @@ int connectToServer(int portNum){
     return serverSocketFileDescriptor;
 }
 
+//connects to server on the same computer using unix domain socket and returns file descriptor
+//for socket connection
+//exits and prints error message if there is an error
+int connectToUnixServer(const char *socketPath){
+	int serverSocketFileDescriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (serverSocketFileDescriptor < 0){
+		fprintf(stderr, "Could not open unix domain socket\n");
+		exit(2);
+	}
+
+	struct sockaddr_un serverAddress;
+	bzero((char *) &serverAddress, sizeof(serverAddress));
+	serverAddress.sun_family = AF_UNIX;
+	strncpy(serverAddress.sun_path, socketPath, sizeof(serverAddress.sun_path) - 1);
+
+	if(connect(serverSocketFileDescriptor, (struct sockaddr*) &serverAddress, sizeof(serverAddress)) < 0){
+		fprintf(stderr, "Could not connect to server on %s\n", socketPath);
+		exit(2);
+	}
+	return serverSocketFileDescriptor;
+}
+
+//connects to server at endpoint using tcp or unix domain socket, and returns file descriptor
+//for socket connection
+//exits and prints error message if there is an error
+int connectToEndpoint(OtpClientEndpoint *endpoint){
+	if(endpoint->unixSocketPath != NULL){
+		return connectToUnixServer(endpoint->unixSocketPath);
+	}
+	int serverSocketFileDescriptor = connectToServer(endpoint->port);
+	//messages are sent one at a time and wait for a reply, so don't wait to fill packets
+	setSocketNoDelay(serverSocketFileDescriptor, 1);
+	return serverSocketFileDescriptor;
+}
+
 /*
 * Helper functions for reading/writing to sockets
 */
 //sends message to server identified by file descriptor
 void sendToSocket(int serverSocketFileDescriptor, char *message){
-  //send message to server
-  int charCountTransferred = write(serverSocketFileDescriptor, message, strlen(message));
-  //check for errors writing
-  if(charCountTransferred < 0){
+  //send message to server, looping until all of it is written
+  if(writeAllToSocket(serverSocketFileDescriptor, message, strlen(message)) < 0){
     fprintf(stderr, "Could not send message to server\n");
     	exit(1);
   }
 }
 
-//returns 1 if data has finished being sent, and 0 if not
-//uses presence of control character at the end of the string to know if
-//data is finished
-int isDataComplete(char *data){
-  //sanity check first
-  assert(data != NULL);
-  //get length, since we need to check last character
-  int length = strlen(data);
-  //check to see if data is empty, since data must have length
-  if(length <= 0){
-    return 0;
-  }
-  //check last char
-  return data[length - 1] == DATA_TERMINATING_CHAR;
-}
-
 
-//gets data from client using socket, and saves in data argument
+//gets data from server using socket, and saves in data argument
 //data should end in \n char, and since that should be the only
-//newline char in the string, we will know that receiving from the client is 
+//newline char in the string, we will know that receiving from the server is 
 //done
-void getDataFromServer(int serverSocketFileDescriptor, char *data){
-  //use while loop to receive data, since it might take multiple requests
-  //specifically do-while, since we need it to run at least one time
-  
-  //create variables so new data gets added to end of buffer
-  //subtract one from buffer size to allow for null char at end
-  int bufferSize = MESSAGE_BUFFER_SIZE - 1;
-  char *dataCurrentPointer = data;
-  do{
-    int charCountTransferred = read(serverSocketFileDescriptor, dataCurrentPointer, bufferSize);
-    //check that read succeeded
-    if(charCountTransferred < 0){
+//dataSize is the number of bytes data can hold, including the null char
+//returns length of data, including the \n char
+int getDataFromServer(BufferedConnection *connection, char *data, size_t dataSize){
+  ssize_t dataLength = readFromSocketUntilTerminator(connection, data, dataSize, DATA_TERMINATING_CHAR);
+  //check that read succeeded
+  if(dataLength < 0){
     	fprintf(stderr, "There was a problem receiving data from server\n");
     	exit(1);
-    }
-    //modify variables so new data gets added on to the end
-    bufferSize -= charCountTransferred;
-    dataCurrentPointer += charCountTransferred;
-
-  }while(!isDataComplete(data) && bufferSize > 0);
-
+  }
+  return dataLength;
 }
 
 
 //sends first line of file to server (file should only have one line in it)
-void sendFileToServer(int serverSocketFileDescriptor, char *fileName){
+//only the first maxLength characters of the line are sent, followed by the terminator
+void sendFileToServer(int serverSocketFileDescriptor, char *fileName, long maxLength){
 	FILE *filePointer = openFileByName(fileName);
 	//read file line by line and check that it contains valid characters
 	//based on: http://stackoverflow.com/questions/3501338/c-read-file-line-by-line
@@ -337,7 +470,14 @@ void sendFileToServer(int serverSocketFileDescriptor, char *fileName){
 		if(linesRead > 0){
 			break;
 		}
-		sendToSocket(serverSocketFileDescriptor, line);
+		//line is cut short if needed, so make sure it is terminated, even if file doesn't end in newline
+		int sendResult = read > maxLength || read == 0 || line[read - 1] != DATA_TERMINATING_CHAR ?
+			writeToSocketWithTerminator(serverSocketFileDescriptor, line, read > maxLength ? maxLength : read, DATA_TERMINATING_CHAR) :
+			writeAllToSocket(serverSocketFileDescriptor, line, read);
+		if(sendResult < 0){
+			fprintf(stderr, "Could not send message to server\n");
+			exit(1);
+		}
 
 		linesRead++;
 	}
@@ -351,15 +491,11 @@ void sendFileToServer(int serverSocketFileDescriptor, char *fileName){
 
 
 /*
- * Main program
+ * Requests to server
  */
-int main(int argc, char *argv[]){
-	//validate command line arguments, and get values from arguments
-	validateCommandLineArgumentsLength(argc, argv);
-	int portNum = getPortNum(argc, argv);
-	char *messageFileName = argv[1];
-	char *keyFileName = argv[2];
-
+//sends message and key files containing A-Z and space to server
+//and prints encoded or decoded result
+void runTextRequest(OtpClientEndpoint *endpoint, char *messageFileName, char *keyFileName){
 	//check message and key to make sure they contain valid characters
 	int messageLength = checkFileContents(messageFileName);
 	int keyLength = checkFileContents(keyFileName);
@@ -369,39 +505,45 @@ int main(int argc, char *argv[]){
 		exit(1);
 	}
 
-	//initialize buffer for messages to server
-	char *messageBuffer = createBuffer(MESSAGE_BUFFER_SIZE);
+	//initialize buffer for replies from server, which are never longer than the message and its terminator
+	//except for error messages, which always fit in a header buffer
+	int messageBufferSize = (messageLength > HEADER_BUFFER_SIZE ? messageLength : HEADER_BUFFER_SIZE) + 2;
+	char *messageBuffer = createBuffer(messageBufferSize);
 
 	//connect to server
-	int serverSocketFileDescriptor = connectToServer(portNum);
+	int serverSocketFileDescriptor = connectToEndpoint(endpoint);
+	//used to read from server, so that replies sent together aren't lost between reads
+	BufferedConnection *connection = malloc(sizeof(BufferedConnection));
+	assert(connection != NULL);
+	initializeBufferedConnection(connection, serverSocketFileDescriptor);
 
 	//send identification message
 	sendToSocket(serverSocketFileDescriptor, CLIENT_IDENTIFICATION_HEADER);
 
 	//check for server confirmation
-	getDataFromServer(serverSocketFileDescriptor, messageBuffer);
+	getDataFromServer(connection, messageBuffer, messageBufferSize);
 	if(strcmp(messageBuffer, OK_MESSAGE) != 0){
 		fprintf(stderr, "This program is not authorized to access that server\n");
 		exit(1);
 	}
 
-	//send key file
-	sendFileToServer(serverSocketFileDescriptor, keyFileName);
+	//send only as much of key file as message needs, so keys longer than the server's buffer can be used
+	sendFileToServer(serverSocketFileDescriptor, keyFileName, messageLength);
 
 	//check for server confirmation
-	getDataFromServer(serverSocketFileDescriptor, messageBuffer);
+	getDataFromServer(connection, messageBuffer, messageBufferSize);
 	if(strcmp(messageBuffer, OK_MESSAGE) != 0){
 		fprintf(stderr, "The server had problems receiving the key file\n");
 		exit(1);
 	}
 
 	//send message file
-	sendFileToServer(serverSocketFileDescriptor, messageFileName);
+	sendFileToServer(serverSocketFileDescriptor, messageFileName, messageLength);
 
 
 	//get results of combining key and message file from server and print result
-	getDataFromServer(serverSocketFileDescriptor, messageBuffer);
-	printf("%s", messageBuffer);
+	int resultLength = getDataFromServer(connection, messageBuffer, messageBufferSize);
+	fwrite(messageBuffer, sizeof(char), resultLength, stdout);
 
 	//free message buffer
 	//program might exit due to error before we reach this, which isn't ideal
@@ -409,6 +551,841 @@ int main(int argc, char *argv[]){
 	//will just reclaim the memory
 	//http://stackoverflow.com/questions/654754/what-really-happens-when-you-dont-free-after-malloc
 	free(messageBuffer);
+	free(connection);
+	close(serverSocketFileDescriptor);
+}
+
+//sends any bytes in message and key files to server to be combined with exclusive or
+//and writes the result to stdout
+void runXorRequest(OtpClientEndpoint *endpoint, char *messageFileName, char *keyFileName){
+	long messageLength;
+	long keyLength;
+	//one byte more than the limit is enough to tell that message is too long
+	char *message = readFileStart(messageFileName, &messageLength, MAX_XOR_MESSAGE_SIZE + 1);
+	if(messageLength == 0 || messageLength > MAX_XOR_MESSAGE_SIZE){
+		fprintf(stderr, "%s must contain between 1 and %ld bytes\n", messageFileName, MAX_XOR_MESSAGE_SIZE);
+		exit(1);
+	}
+	//only as much key as message needs is read and sent
+	char *key = readFileStart(keyFileName, &keyLength, messageLength);
+	if(keyLength < messageLength){
+		fprintf(stderr, "Number of bytes in key file must be greater than or equal number of bytes in message file\n");
+		exit(1);
+	}
+
+	int serverSocketFileDescriptor = connectToEndpoint(endpoint);
+	BufferedConnection *connection = malloc(sizeof(BufferedConnection));
+	assert(connection != NULL);
+	initializeBufferedConnection(connection, serverSocketFileDescriptor);
+
+	//send identification message with number of bytes
+	char header[HEADER_BUFFER_SIZE];
+	snprintf(header, HEADER_BUFFER_SIZE, "%s%ld\n", XOR_MESSAGE_HEADER_PREFIX, messageLength);
+	sendToSocket(serverSocketFileDescriptor, header);
+
+	//check for server confirmation
+	getDataFromServer(connection, header, HEADER_BUFFER_SIZE);
+	if(header[0] == SERVER_ERROR_CHAR && strcmp(header, OK_MESSAGE) != 0){
+		fprintf(stderr, "Server could not handle request: %s", header + 1);
+		exit(1);
+	}
+	if(strcmp(header, OK_MESSAGE) != 0){
+		fprintf(stderr, "This program is not authorized to access that server\n");
+		exit(1);
+	}
+
+	//send only as much key as is needed, followed by message, in one system call
+	struct iovec vectors[2] = {
+		{key, messageLength},
+		{message, messageLength}
+	};
+	if(writeVectorsToSocket(serverSocketFileDescriptor, vectors, 2) < 0){
+		fprintf(stderr, "Could not send message to server\n");
+		exit(1);
+	}
+
+	//result is exactly as long as message, so it can be received in place of message
+	if(readFromSocketExactly(connection, message, messageLength) < 0){
+		fprintf(stderr, "There was a problem receiving data from server\n");
+		exit(1);
+	}
+	fwrite(message, sizeof(char), messageLength, stdout);
+
+	free(message);
+	free(key);
+	free(connection);
+	close(serverSocketFileDescriptor);
+}
+
+
+/*
+ * Stream mode
+ */
+//reads next chunk of message from stdin into buffer, stopping at first newline
+//returns number of characters read, 0 at end of message, or exits on error
+//only one read is done, so data is sent as soon as it is available
+long readStreamChunk(char *buffer, int *isMessageFinished){
+	if(*isMessageFinished){
+		return 0;
+	}
+	ssize_t chunkLength;
+	do{
+		chunkLength = read(STDIN_FILENO, buffer, STREAM_CHUNK_SIZE);
+	}while(chunkLength < 0 && errno == EINTR);
+	if(chunkLength < 0){
+		fprintf(stderr, "Could not read from stdin\n");
+		exit(1);
+	}
+	//message ends at end of first line or end of input
+	char *terminator = memchr(buffer, DATA_TERMINATING_CHAR, chunkLength);
+	if(terminator != NULL){
+		chunkLength = terminator - buffer;
+		*isMessageFinished = 1;
+	}
+	else if(chunkLength == 0){
+		*isMessageFinished = 1;
+	}
+	return chunkLength;
+}
+
+//connects to server at endpoint and starts stream request with identification header followed by headerSuffix
+//connection is initialized with the new socket
+//returns 1 if server accepted request, or 0 if it didn't, in which case the socket is closed
+int startStreamRequest(OtpClientEndpoint *endpoint, BufferedConnection *connection, char *headerSuffix){
+	int serverSocketFileDescriptor = connectToEndpoint(endpoint);
+	initializeBufferedConnection(connection, serverSocketFileDescriptor);
+
+	//stream header is identification header without its terminator, followed by stream suffix
+	char header[HEADER_BUFFER_SIZE];
+	snprintf(header, HEADER_BUFFER_SIZE, "%.*s%s", (int)strlen(CLIENT_IDENTIFICATION_HEADER) - 1, CLIENT_IDENTIFICATION_HEADER, headerSuffix);
+	sendToSocket(serverSocketFileDescriptor, header);
+	//server closing the connection is treated the same as refusing it
+	if(readFromSocketUntilTerminator(connection, header, HEADER_BUFFER_SIZE, DATA_TERMINATING_CHAR) < 0 || strcmp(header, OK_MESSAGE) != 0){
+		close(serverSocketFileDescriptor);
+		return 0;
+	}
+	return 1;
+}
+
+//sends chunk length followed by chunk of key and message in stream mode, in one system call
+//exits and prints error message if there is an error
+void sendStreamChunk(BufferedConnection *connection, char *key, char *message, long chunkLength){
+	char chunkHeader[HEADER_BUFFER_SIZE];
+	snprintf(chunkHeader, HEADER_BUFFER_SIZE, "%ld\n", chunkLength);
+	struct iovec vectors[3] = {
+		{chunkHeader, strlen(chunkHeader)},
+		{key, chunkLength},
+		{message, chunkLength}
+	};
+	if(writeVectorsToSocket(connection->fileDescriptor, vectors, 3) < 0){
+		fprintf(stderr, "Could not send message to server\n");
+		exit(1);
+	}
+}
+
+//receives transformed chunk of chunkLength characters in stream mode into message
+//exits and prints error message if there is an error
+void receiveStreamResult(BufferedConnection *connection, char *message, long chunkLength){
+	//transformed chunk is the same length, and replaces message chunk
+	//error messages are shorter than the chunk, so the server closing the connection means an error was sent
+	ssize_t resultLength = readFromSocketExactly(connection, message, chunkLength);
+	if(resultLength < 0 || message[0] == SERVER_ERROR_CHAR){
+		fprintf(stderr, "There was a problem receiving data from server\n");
+		exit(1);
+	}
+}
+
+//sends chunk of key and message in compressed stream mode
+//message is compressed into compressedData, which must hold chunkLength characters, if results aren't plaintext
+//exits and prints error message if there is an error
+void sendCompressedStreamChunk(BufferedConnection *connection, char *key, char *message, long chunkLength, char *compressedData){
+	char *messageData = message;
+	size_t messageDataLength = chunkLength;
+	//only accept compression that makes message shorter, otherwise it is sent as it is
+	if(!IS_RESULT_PLAINTEXT){
+		size_t compressedLength = otpCompress(message, chunkLength, compressedData, chunkLength - 1);
+		if(compressedLength > 0){
+			messageData = compressedData;
+			messageDataLength = compressedLength;
+		}
+	}
+
+	//send chunk length, message data length, key and message data in one system call
+	char chunkHeader[HEADER_BUFFER_SIZE];
+	snprintf(chunkHeader, HEADER_BUFFER_SIZE, "%ld %zu\n", chunkLength, messageDataLength);
+	struct iovec vectors[3] = {
+		{chunkHeader, strlen(chunkHeader)},
+		{key, chunkLength},
+		{messageData, messageDataLength}
+	};
+	if(writeVectorsToSocket(connection->fileDescriptor, vectors, 3) < 0){
+		fprintf(stderr, "Could not send message to server\n");
+		exit(1);
+	}
+}
+
+//receives transformed chunk of chunkLength characters in compressed stream mode into message
+//compressedData must hold chunkLength characters, and is used for results that were compressed
+//exits and prints error message if there is an error
+void receiveCompressedStreamResult(BufferedConnection *connection, char *message, long chunkLength, char *compressedData){
+	//result is sent after a line with the length of its data, or an error line starting with '@'
+	char chunkHeader[HEADER_BUFFER_SIZE];
+	char *lengthEnd;
+	long resultDataLength = -1;
+	if(readFromSocketUntilTerminator(connection, chunkHeader, HEADER_BUFFER_SIZE, DATA_TERMINATING_CHAR) >= 0 && chunkHeader[0] != SERVER_ERROR_CHAR){
+		resultDataLength = strtol(chunkHeader, &lengthEnd, 10);
+		if(lengthEnd == chunkHeader || *lengthEnd != DATA_TERMINATING_CHAR || resultDataLength <= 0 || resultDataLength > chunkLength){
+			resultDataLength = -1;
+		}
+	}
+	//transformed chunk replaces message chunk
+	int isReceived = resultDataLength > 0;
+	if(isReceived && resultDataLength == chunkLength){
+		isReceived = readFromSocketExactly(connection, message, chunkLength) >= 0;
+	}
+	else if(isReceived){
+		isReceived = readFromSocketExactly(connection, compressedData, resultDataLength) >= 0 && otpDecompress(compressedData, resultDataLength, message, chunkLength) == chunkLength;
+	}
+	if(!isReceived){
+		fprintf(stderr, "There was a problem receiving data from server\n");
+		exit(1);
+	}
+}
+
+//waits until either server has sent data or stdin can be read
+//returns 1 if data from server should be received first, or 0 if stdin is ready
+int isServerDataReady(BufferedConnection *connection){
+	//data may already have been read ahead with an earlier result
+	if(connection->readPosition < connection->readFill){
+		return 1;
+	}
+	struct pollfd fileDescriptors[2] = {
+		{connection->fileDescriptor, POLLIN, 0},
+		{STDIN_FILENO, POLLIN, 0}
+	};
+	while(poll(fileDescriptors, 2, -1) < 0){
+		if(errno != EINTR){
+			fprintf(stderr, "Could not wait for data from server\n");
+			exit(1);
+		}
+	}
+	//server data is preferred, so results are printed as soon as they arrive
+	//errors and hang ups are found by reading
+	return fileDescriptors[0].revents != 0 || fileDescriptors[1].revents == 0;
+}
+
+//reads message from stdin and sends it to server in chunks, together with the same length chunks of key file
+//each transformed chunk is written to stdout as soon as it is received, so memory used doesn't depend on message length
+//up to STREAM_CHUNKS_IN_FLIGHT chunks are sent before their results are received, so reading stdin, sending chunks
+//and transforming them on the server overlap
+//if isCompressed is true, plaintext is compressed when the server supports it, otherwise a plain stream is used
+void runStreamRequest(OtpClientEndpoint *endpoint, char *keyFileName, int isCompressed){
+	FILE *keyFile = openFileByName(keyFileName);
+	char *messages[STREAM_CHUNKS_IN_FLIGHT];
+	long chunkLengths[STREAM_CHUNKS_IN_FLIGHT];
+	char *key = malloc(STREAM_CHUNK_SIZE);
+	assert(key != NULL);
+	int i;
+	for(i = 0; i < STREAM_CHUNKS_IN_FLIGHT; ++i){
+		messages[i] = malloc(STREAM_CHUNK_SIZE);
+		assert(messages[i] != NULL);
+	}
+
+	BufferedConnection *connection = malloc(sizeof(BufferedConnection));
+	assert(connection != NULL);
+	//servers that don't support compression refuse its header, so try again with a plain stream
+	if(isCompressed && !startStreamRequest(endpoint, connection, COMPRESSED_STREAM_MESSAGE_HEADER_SUFFIX)){
+		isCompressed = 0;
+	}
+	if(!isCompressed && !startStreamRequest(endpoint, connection, STREAM_MESSAGE_HEADER_SUFFIX)){
+		fprintf(stderr, "This program is not authorized to access that server\n");
+		exit(1);
+	}
+	int serverSocketFileDescriptor = connection->fileDescriptor;
+	//server sends results while client is still sending the next chunk, so there must be room for them
+	//results of compressed streams are never longer than their chunk, plus a line with their length
+	reserveSocketReceiveBuffer(serverSocketFileDescriptor, STREAM_CHUNKS_IN_FLIGHT * (STREAM_CHUNK_SIZE + HEADER_BUFFER_SIZE));
+	char *compressedData = NULL;
+	if(isCompressed){
+		compressedData = malloc(STREAM_CHUNK_SIZE);
+		assert(compressedData != NULL);
+	}
+
+	int isMessageFinished = 0;
+	long totalLength = 0;
+	//chunks are numbered in the order they are sent, and use message buffers in turn
+	long sentCount = 0;
+	long receivedCount = 0;
+	while(!isMessageFinished || receivedCount < sentCount){
+		int isSendingAllowed = !isMessageFinished && sentCount - receivedCount < STREAM_CHUNKS_IN_FLIGHT;
+		if(receivedCount < sentCount && (!isSendingAllowed || isServerDataReady(connection))){
+			int resultIndex = receivedCount % STREAM_CHUNKS_IN_FLIGHT;
+			char *message = messages[resultIndex];
+			long chunkLength = chunkLengths[resultIndex];
+			if(isCompressed){
+				receiveCompressedStreamResult(connection, message, chunkLength, compressedData);
+			}
+			else{
+				receiveStreamResult(connection, message, chunkLength);
+			}
+			//output is flushed after each chunk, so the next program in a pipeline gets it right away
+			fwrite(message, sizeof(char), chunkLength, stdout);
+			fflush(stdout);
+			receivedCount++;
+			continue;
+		}
+
+		int chunkIndex = sentCount % STREAM_CHUNKS_IN_FLIGHT;
+		char *message = messages[chunkIndex];
+		long chunkLength = readStreamChunk(message, &isMessageFinished);
+		if(chunkLength == 0){
+			continue;
+		}
+		//key file is read in step with message, and can't end early
+		if(fread(key, sizeof(char), chunkLength, keyFile) != (size_t)chunkLength || memchr(key, DATA_TERMINATING_CHAR, chunkLength) != NULL){
+			fprintf(stderr, "Number of characters in key file must be greater than or equal number of characters in message\n");
+			exit(1);
+		}
+		if(!otpIsValidText(message, chunkLength) || !otpIsValidText(key, chunkLength)){
+			fprintf(stderr, "Message or key file contains characters other than uppercase letters and spaces\n");
+			exit(1);
+		}
+
+		if(isCompressed){
+			sendCompressedStreamChunk(connection, key, message, chunkLength, compressedData);
+		}
+		else{
+			sendStreamChunk(connection, key, message, chunkLength);
+		}
+		chunkLengths[chunkIndex] = chunkLength;
+		sentCount++;
+		totalLength += chunkLength;
+	}
+	if(totalLength == 0){
+		fprintf(stderr, "stdin is empty\n");
+		exit(1);
+	}
+
+	//chunk length of 0 ends stream
+	sendToSocket(serverSocketFileDescriptor, isCompressed ? "0 0\n" : "0\n");
+	//output ends with newline, the same as when message is read from a file
+	putchar(DATA_TERMINATING_CHAR);
+
+	free(compressedData);
+	for(i = 0; i < STREAM_CHUNKS_IN_FLIGHT; ++i){
+		free(messages[i]);
+	}
+	free(key);
+	free(connection);
+	fclose(keyFile);
+	close(serverSocketFileDescriptor);
+}
+
+
+/*
+ * Shared memory mode
+ */
+//sends message and key to server on the same computer through a shared memory ring buffer
+//client copies chunks of key and message into free slots of the ring and tells server their offsets,
+//server transforms message in place, and client prints each slot once server says it is done
+void runSharedMemoryRequest(OtpClientEndpoint *endpoint, char *messageFileName, char *keyFileName){
+	if(endpoint->unixSocketPath == NULL){
+		fprintf(stderr, "Shared memory mode needs the path of a server's unix domain socket\n");
+		exit(1);
+	}
+	long messageLength;
+	long keyLength;
+	char *message = loadMessageFile(messageFileName, &messageLength, 0);
+	char *key = message != NULL ? loadMessageFile(keyFileName, &keyLength, 0) : NULL;
+	if(key == NULL){
+		exit(1);
+	}
+	if(keyLength < messageLength){
+		fprintf(stderr, "Number of characters in key file must be greater than or equal number of characters in message file\n");
+		exit(1);
+	}
+
+	int serverSocketFileDescriptor = connectToEndpoint(endpoint);
+	BufferedConnection *connection = malloc(sizeof(BufferedConnection));
+	assert(connection != NULL);
+	initializeBufferedConnection(connection, serverSocketFileDescriptor);
+
+	//shared memory header is identification header without its terminator, followed by suffix and size
+	char line[HEADER_BUFFER_SIZE];
+	snprintf(line, HEADER_BUFFER_SIZE, "%.*s%s%d\n", (int)strlen(CLIENT_IDENTIFICATION_HEADER) - 1, CLIENT_IDENTIFICATION_HEADER, SHARED_MEMORY_MESSAGE_HEADER_SUFFIX, SHARED_MEMORY_RING_SIZE);
+	sendToSocket(serverSocketFileDescriptor, line);
+	getDataFromServer(connection, line, HEADER_BUFFER_SIZE);
+	if(strcmp(line, OK_MESSAGE) != 0){
+		fprintf(stderr, "This program is not authorized to access that server\n");
+		exit(1);
+	}
+
+	//create shared memory and send it to server, which has its own copy of the file descriptor after that
+	int sharedMemoryFileDescriptor = createSharedMemory(SHARED_MEMORY_RING_SIZE);
+	char *ring = sharedMemoryFileDescriptor >= 0 ? mmap(NULL, SHARED_MEMORY_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, sharedMemoryFileDescriptor, 0) : MAP_FAILED;
+	if(ring == MAP_FAILED || sendFileDescriptor(serverSocketFileDescriptor, sharedMemoryFileDescriptor) < 0){
+		fprintf(stderr, "Could not create shared memory\n");
+		exit(1);
+	}
+	close(sharedMemoryFileDescriptor);
+	getDataFromServer(connection, line, HEADER_BUFFER_SIZE);
+	if(strcmp(line, OK_MESSAGE) != 0){
+		fprintf(stderr, "The server could not use shared memory\n");
+		exit(1);
+	}
+
+	long slotSize = SHARED_MEMORY_RING_SIZE / SHARED_MEMORY_SLOT_COUNT;
+	long chunkSize = slotSize / 2;
+	long chunkCount = (messageLength + chunkSize - 1) / chunkSize;
+	long chunksSubmitted = 0;
+	long chunksCompleted = 0;
+	//request lines for every free slot are sent together
+	char requests[SHARED_MEMORY_SLOT_COUNT * HEADER_BUFFER_SIZE];
+	while(chunksCompleted < chunkCount){
+		int requestsLength = 0;
+		while(chunksSubmitted < chunkCount && chunksSubmitted - chunksCompleted < SHARED_MEMORY_SLOT_COUNT){
+			long slotOffset = (chunksSubmitted % SHARED_MEMORY_SLOT_COUNT) * slotSize;
+			long chunkOffset = chunksSubmitted * chunkSize;
+			long length = messageLength - chunkOffset < chunkSize ? messageLength - chunkOffset : chunkSize;
+			//key goes in first half of slot, and message in second half
+			memcpy(ring + slotOffset, key + chunkOffset, length);
+			memcpy(ring + slotOffset + chunkSize, message + chunkOffset, length);
+			requestsLength += snprintf(requests + requestsLength, HEADER_BUFFER_SIZE, "%ld %ld %ld\n", slotOffset + chunkSize, slotOffset, length);
+			chunksSubmitted++;
+		}
+		if(requestsLength > 0 && writeAllToSocket(serverSocketFileDescriptor, requests, requestsLength) < 0){
+			fprintf(stderr, "Could not send message to server\n");
+			exit(1);
+		}
+
+		//server finishes chunks in the order they were sent
+		getDataFromServer(connection, line, HEADER_BUFFER_SIZE);
+		if(strcmp(line, OK_MESSAGE) != 0){
+			fprintf(stderr, "%s", line);
+			exit(1);
+		}
+		long slotOffset = (chunksCompleted % SHARED_MEMORY_SLOT_COUNT) * slotSize;
+		long chunkOffset = chunksCompleted * chunkSize;
+		long length = messageLength - chunkOffset < chunkSize ? messageLength - chunkOffset : chunkSize;
+		fwrite(ring + slotOffset + chunkSize, sizeof(char), length, stdout);
+		chunksCompleted++;
+	}
+	//output ends with newline, the same as other modes
+	putchar(DATA_TERMINATING_CHAR);
+
+	munmap(ring, SHARED_MEMORY_RING_SIZE);
+	free(connection);
+	free(message);
+	free(key);
+	close(serverSocketFileDescriptor);
+}
+
+
+/*
+ * Client library requests
+ */
+//prints error for request sent using client library that failed
+//description says which request failed
+void printRequestError(char *description, int status, const char *result, size_t resultLength){
+	if(status == OTP_CLIENT_ERROR_SERVER){
+		fprintf(stderr, "%s: %.*s\n", description, (int)resultLength, result);
+	}
+	else{
+		fprintf(stderr, "%s: Could not connect to server\n", description);
+	}
+}
+
+
+/*
+ * Batch mode
+ */
+//key file used by batch entries
+//kept in memory until the last entry using it finishes, so consecutive entries with the same key file only read it once
+typedef struct BatchKeyFile{
+	char *fileName;
+	char *data;
+	long length;
+	//number of unfinished entries using key file, plus one while it is the most recent key file
+	int referenceCount;
+} BatchKeyFile;
+
+//state of batch being processed from manifest file
+typedef struct Batch{
+	FILE *manifest;
+	char *manifestFileName;
+	int lineNumber;
+	OtpClientPool *pool;
+	int isXorMode;
+	BatchKeyFile *currentKeyFile;
+	//number of entries submitted whose results haven't been received
+	int unfinishedCount;
+	int failureCount;
+} Batch;
+
+//one line of manifest, submitted as a request
+typedef struct BatchEntry{
+	Batch *batch;
+	char *outputFileName;
+	char *message;
+	BatchKeyFile *keyFile;
+} BatchEntry;
+
+//removes one reference to key file, and frees it when there are none left
+void releaseBatchKeyFile(BatchKeyFile *keyFile){
+	keyFile->referenceCount--;
+	if(keyFile->referenceCount == 0){
+		free(keyFile->fileName);
+		free(keyFile->data);
+		free(keyFile);
+	}
+}
+
+//returns key file with given name, reading it only if it is different than the last key file
+//returns NULL if key file is invalid
+BatchKeyFile * getBatchKeyFile(Batch *batch, char *fileName){
+	if(batch->currentKeyFile != NULL && strcmp(batch->currentKeyFile->fileName, fileName) == 0){
+		return batch->currentKeyFile;
+	}
+	if(batch->currentKeyFile != NULL){
+		releaseBatchKeyFile(batch->currentKeyFile);
+		batch->currentKeyFile = NULL;
+	}
+	BatchKeyFile *keyFile = malloc(sizeof(BatchKeyFile));
+	assert(keyFile != NULL);
+	keyFile->data = loadMessageFile(fileName, &keyFile->length, batch->isXorMode);
+	if(keyFile->data == NULL){
+		free(keyFile);
+		return NULL;
+	}
+	keyFile->fileName = strdup(fileName);
+	keyFile->referenceCount = 1;
+	batch->currentKeyFile = keyFile;
+	return keyFile;
+}
+
+//called by client library when result for entry is received, and writes result to entry's output file
+void finishBatchEntry(int status, const char *result, size_t resultLength, void *userData){
+	BatchEntry *entry = userData;
+	Batch *batch = entry->batch;
+	batch->unfinishedCount--;
+
+	if(status != OTP_CLIENT_OK){
+		printRequestError(entry->outputFileName, status, result, resultLength);
+		batch->failureCount++;
+	}
+	else{
+		FILE *outputFile = fopen(entry->outputFileName, "w");
+		//text results are terminated by newline, the same as output to stdout
+		if(outputFile == NULL || fwrite(result, sizeof(char), resultLength, outputFile) != resultLength || (!batch->isXorMode && fputc(DATA_TERMINATING_CHAR, outputFile) == EOF)){
+			fprintf(stderr, "Could not write %s\n", entry->outputFileName);
+			batch->failureCount++;
+		}
+		if(outputFile != NULL){
+			fclose(outputFile);
+		}
+	}
+
+	releaseBatchKeyFile(entry->keyFile);
+	free(entry->message);
+	free(entry->outputFileName);
+	free(entry);
+}
+
+//parses key offset column of manifest line, which is a whole number of characters
+//returns offset, or -1 if it isn't a valid offset
+long parseKeyOffset(char *keyOffsetString){
+	char *offsetEnd;
+	errno = 0;
+	long keyOffset = strtol(keyOffsetString, &offsetEnd, 10);
+	//whole column must be the number, so things like "12x" aren't taken as 12
+	if(errno != 0 || offsetEnd == keyOffsetString || *offsetEnd != '\0' || keyOffset < 0){
+		return -1;
+	}
+	return keyOffset;
+}
+
+//reads next line of manifest, loads files for it and submits request
+//returns 0 when there are no more lines, otherwise 1, even if line is invalid
+int submitNextBatchEntry(Batch *batch){
+	char *line = NULL;
+	size_t len = 0;
+	char *messageFileName;
+	char *keyFileName;
+	char *outputFileName;
+	char *keyOffsetString;
+	//skip blank and comment lines
+	do{
+		if(getline(&line, &len, batch->manifest) == -1){
+			free(line);
+			return 0;
+		}
+		batch->lineNumber++;
+		messageFileName = strtok(line, " \t\n");
+	}while(messageFileName == NULL || messageFileName[0] == '#');
+
+	keyFileName = strtok(NULL, " \t\n");
+	outputFileName = strtok(NULL, " \t\n");
+	keyOffsetString = strtok(NULL, " \t\n");
+	long keyOffset = keyOffsetString != NULL ? parseKeyOffset(keyOffsetString) : 0;
+	if(keyFileName == NULL || outputFileName == NULL || keyOffset < 0){
+		fprintf(stderr, "%s line %d: expected <plaintext_file> <key_file> <output_file> [<key_offset>]\n", batch->manifestFileName, batch->lineNumber);
+		batch->failureCount++;
+		free(line);
+		return 1;
+	}
+
+	long messageLength;
+	char *message = loadMessageFile(messageFileName, &messageLength, batch->isXorMode);
+	BatchKeyFile *keyFile = message != NULL ? getBatchKeyFile(batch, keyFileName) : NULL;
+	if(keyFile != NULL && keyFile->length - keyOffset < messageLength){
+		fprintf(stderr, "%s line %d: key is shorter than message\n", batch->manifestFileName, batch->lineNumber);
+		keyFile = NULL;
+	}
+	if(keyFile == NULL){
+		batch->failureCount++;
+		free(message);
+		free(line);
+		return 1;
+	}
+
+	BatchEntry *entry = malloc(sizeof(BatchEntry));
+	assert(entry != NULL);
+	entry->batch = batch;
+	entry->outputFileName = strdup(outputFileName);
+	entry->message = message;
+	entry->keyFile = keyFile;
+	keyFile->referenceCount++;
+	batch->unfinishedCount++;
+	//callback is never run for a request that couldn't be submitted, so undo what it would have
+	if(otpClientSubmit(batch->pool, batch->isXorMode ? OTP_CLIENT_XOR : CLIENT_REQUEST_TYPE, message, keyFile->data + keyOffset, messageLength, &finishBatchEntry, entry) < 0){
+		fprintf(stderr, "%s line %d: could not submit request\n", batch->manifestFileName, batch->lineNumber);
+		batch->unfinishedCount--;
+		batch->failureCount++;
+		releaseBatchKeyFile(keyFile);
+		free(entry->outputFileName);
+		free(entry);
+		free(message);
+	}
+
+	free(line);
+	return 1;
+}
+
+//processes every line of manifest file using connectionCount connections to server
+//returns number of lines that failed
+//connections are spread across all endpoints
+int runBatch(OtpClientEndpoint *endpoints, int endpointCount, char *manifestFileName, int connectionCount, int isXorMode){
+	Batch batch;
+	memset(&batch, 0, sizeof(batch));
+	batch.manifestFileName = manifestFileName;
+	batch.manifest = openFileByName(manifestFileName);
+	batch.isXorMode = isXorMode;
+
+	//at least one connection to every server
+	int connectionsPerEndpoint = (connectionCount + endpointCount - 1) / endpointCount;
+	connectionCount = connectionsPerEndpoint * endpointCount;
+	batch.pool = otpClientPoolCreate(endpoints, endpointCount, connectionsPerEndpoint);
+	assert(batch.pool != NULL);
+
+	//keep enough requests submitted that connections never wait for files to be read
+	int isManifestFinished = 0;
+	while(1){
+		while(!isManifestFinished && batch.unfinishedCount < connectionCount * BATCH_REQUESTS_PER_CONNECTION){
+			isManifestFinished = !submitNextBatchEntry(&batch);
+		}
+		if(batch.unfinishedCount == 0){
+			break;
+		}
+		if(otpClientPoll(batch.pool, -1) < 0){
+			fprintf(stderr, "There was a problem receiving data from server\n");
+			exit(1);
+		}
+	}
+
+	otpClientPoolDestroy(batch.pool);
+	if(batch.currentKeyFile != NULL){
+		releaseBatchKeyFile(batch.currentKeyFile);
+	}
+	fclose(batch.manifest);
+	return batch.failureCount;
+}
+
+
+/*
+ * Striping across servers
+ */
+//message being split across servers
+typedef struct StripedRequest{
+	char *output;
+	int failureCount;
+} StripedRequest;
+
+//part of message sent to one server, tagged with where its result goes in the output
+typedef struct Stripe{
+	StripedRequest *request;
+	size_t offset;
+} Stripe;
+
+//called by client library when result of stripe is received, and copies it into place in the output
+void finishStripe(int status, const char *result, size_t resultLength, void *userData){
+	Stripe *stripe = userData;
+	if(status == OTP_CLIENT_OK){
+		memcpy(stripe->request->output + stripe->offset, result, resultLength);
+	}
+	else{
+		printRequestError("stripe", status, result, resultLength);
+		stripe->request->failureCount++;
+	}
+}
+
+//splits message and key into stripes that are sent to all servers at the same time
+//and prints results in order once all stripes are received
+//one time pad is applied character by character, so stripes can be transformed independently
+void runStripedRequest(OtpClientEndpoint *endpoints, int endpointCount, char *messageFileName, char *keyFileName, int isXorMode){
+	long messageLength;
+	long keyLength;
+	char *message = loadMessageFile(messageFileName, &messageLength, isXorMode);
+	char *key = message != NULL ? loadMessageFile(keyFileName, &keyLength, isXorMode) : NULL;
+	if(key == NULL){
+		exit(1);
+	}
+	if(messageLength == 0){
+		fprintf(stderr, "%s is empty\n", messageFileName);
+		exit(1);
+	}
+	if(keyLength < messageLength){
+		fprintf(stderr, "Number of characters in key file must be greater than or equal number of characters in message file\n");
+		exit(1);
+	}
+
+	long stripeCount = endpointCount * STRIPES_PER_SERVER;
+	long stripeLength = (messageLength + stripeCount - 1) / stripeCount;
+	if(stripeLength < MIN_STRIPE_LENGTH){
+		stripeLength = MIN_STRIPE_LENGTH;
+	}
+	//every stripe has to fit in a server's buffer, leaving room for terminator and null char for text,
+	//so long messages are split into more stripes than that
+	long maxStripeLength = isXorMode ? MAX_XOR_MESSAGE_SIZE : MESSAGE_BUFFER_SIZE - 2;
+	if(stripeLength > maxStripeLength){
+		stripeLength = maxStripeLength;
+	}
+	stripeCount = (messageLength + stripeLength - 1) / stripeLength;
+
+	StripedRequest request = {malloc(messageLength), 0};
+	Stripe *stripes = malloc(sizeof(Stripe) * stripeCount);
+	//one connection per server, and pool sends stripes to each server in turn
+	OtpClientPool *pool = otpClientPoolCreate(endpoints, endpointCount, 1);
+	assert(request.output != NULL && stripes != NULL && pool != NULL);
+
+	long i;
+	for(i = 0; i < stripeCount; ++i){
+		stripes[i].request = &request;
+		stripes[i].offset = i * stripeLength;
+		long length = messageLength - stripes[i].offset < stripeLength ? messageLength - stripes[i].offset : stripeLength;
+		if(otpClientSubmit(pool, isXorMode ? OTP_CLIENT_XOR : CLIENT_REQUEST_TYPE, message + stripes[i].offset, key + stripes[i].offset, length, &finishStripe, &stripes[i]) < 0){
+			fprintf(stderr, "stripe: could not submit request\n");
+			request.failureCount++;
+		}
+	}
+	if(otpClientWaitAll(pool) < 0){
+		fprintf(stderr, "There was a problem receiving data from server\n");
+		exit(1);
+	}
+	if(request.failureCount > 0){
+		exit(1);
+	}
+
+	fwrite(request.output, sizeof(char), messageLength, stdout);
+	//text output ends with newline, the same as when message isn't striped
+	if(!isXorMode){
+		putchar(DATA_TERMINATING_CHAR);
+	}
+
+	otpClientPoolDestroy(pool);
+	free(stripes);
+	free(request.output);
+	free(message);
+	free(key);
+}
+
+
+/*
+ * Main program
+ */
+int main(int argc, char *argv[]){
+	//get options from command line arguments
+	int isXorMode = 0;
+	char *manifestFileName = NULL;
+	int connectionCount = DEFAULT_BATCH_CONNECTION_COUNT;
+	int isStreamMode = 0;
+	int isSharedMemoryMode = 0;
+	int isCompressed = 0;
+	int option;
+	while((option = getopt(argc, argv, "xm:j:sSz")) != -1){
+		switch(option){
+			case 'z':
+				isCompressed = 1;
+				break;
+			case 'S':
+				isSharedMemoryMode = 1;
+				break;
+			case 's':
+				isStreamMode = 1;
+				break;
+			case 'x':
+				isXorMode = 1;
+				break;
+			case 'm':
+				manifestFileName = optarg;
+				break;
+			case 'j':
+				connectionCount = atoi(optarg);
+				if(connectionCount <= 0){
+					printUsage(argv[0]);
+					exit(1);
+				}
+				break;
+			default:
+				printUsage(argv[0]);
+				exit(1);
+		}
+	}
+
+	OtpClientEndpoint endpoints[MAX_SERVER_COUNT];
+
+	//batch mode only needs ports after options
+	if(manifestFileName != NULL){
+		validateCommandLineArgumentsLength(argc, argv, 1);
+		int endpointCount = getEndpoints(argv[optind], endpoints);
+		return runBatch(endpoints, endpointCount, manifestFileName, connectionCount, isXorMode) == 0 ? 0 : 1;
+	}
+
+	//stream mode reads message from stdin, so only needs key file and port
+	if(isStreamMode || isCompressed){
+		validateCommandLineArgumentsLength(argc, argv, 2);
+		getEndpoints(argv[optind + 1], endpoints);
+		runStreamRequest(&endpoints[0], argv[optind], isCompressed);
+		return 0;
+	}
+
+	//validate command line arguments, and get values from arguments
+	validateCommandLineArgumentsLength(argc, argv, 3);
+	char *messageFileName = argv[optind];
+	char *keyFileName = argv[optind + 1];
+	int endpointCount = getEndpoints(argv[optind + 2], endpoints);
+
+	if(isSharedMemoryMode){
+		runSharedMemoryRequest(&endpoints[0], messageFileName, keyFileName);
+	}
+	else if(endpointCount > 1){
+		runStripedRequest(endpoints, endpointCount, messageFileName, keyFileName, isXorMode);
+	}
+	else if(isXorMode){
+		runXorRequest(&endpoints[0], messageFileName, keyFileName);
+	}
+	else{
+		runTextRequest(&endpoints[0], messageFileName, keyFileName);
+	}
 
 	return 0;
-}
\ No newline at end of file
+}
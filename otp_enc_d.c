@@ -14,23 +14,89 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-//for character functions
-#include <ctype.h>
+//for unix domain sockets
+#include <sys/un.h>
+//for mapping shared memory from clients
+#include <sys/mman.h>
+//for waiting on tcp and unix domain sockets at the same time
+#include <poll.h>
+//for restarting and shutting down without dropping connections
+#include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+//for limiting memory used by xor requests of all connections together
+#include <sys/ipc.h>
+#include <sys/sem.h>
+//for limiting how long a restart can take
+#include <time.h>
 //for error checking
 #include <assert.h>
+//for buffered socket reading/writing
+#include "socket_io.h"
+//for encoding and decoding messages
+#include "otp.h"
+//for compressed stream mode
+#include "otp_compress.h"
+//for headers and limits shared with clients
+#include "otp_protocol.h"
 
-//maximum number of characters used for the buffer for messages sent to/from the client
-#define MESSAGE_BUFFER_SIZE 131071
+//requests up to this many characters are stored in space that is part of the connection
+//so they don't need any memory to be allocated, and longer requests grow buffers as data arrives
+#ifndef SMALL_MESSAGE_BUFFER_SIZE
+#define SMALL_MESSAGE_BUFFER_SIZE 4096
+#endif
+
+//messages at least this long are split into segments that are transformed by multiple threads
+//shorter messages are transformed by a single thread, since handing segments to threads costs more than it saves
+//default for the PARALLEL_TRANSFORM_THRESHOLD_VARIABLE environment variable
+#ifndef PARALLEL_TRANSFORM_THRESHOLD
+#define PARALLEL_TRANSFORM_THRESHOLD 1048576
+#endif
+
+//environment variable that sets the threshold when the server starts, so it can be tuned without rebuilding
+#define PARALLEL_TRANSFORM_THRESHOLD_VARIABLE "OTP_PARALLEL_TRANSFORM_THRESHOLD"
+
+//most memory that xor requests of all connections together can use at once, in bytes
+//xor requests allocate as much as they declare, so a request that would go over this waits until others finish,
+//instead of many clients with long requests making the server run out of memory
+#ifndef MAX_XOR_MEMORY_IN_FLIGHT
+#define MAX_XOR_MEMORY_IN_FLIGHT 1073741824L
+#endif
+
+//xor memory is counted in units of this many bytes, so the whole budget fits in a semaphore
+#define XOR_MEMORY_UNIT_SIZE 1048576L
 
 //maximum number of requests that allowed to queue up waiting for server to become available
 #define REQUEST_QUEUE_SIZE 5
 
-//string used as ok message to client
-//so client knows it is ok to send
-#define OK_MESSAGE "@OK\n"
+//kinds of requests client can make, determined from first message
+//client closed connection instead of sending another request
+#define REQUEST_MODE_CLOSED -1
+#define REQUEST_MODE_UNAUTHORIZED 0
+#define REQUEST_MODE_TEXT 1
+#define REQUEST_MODE_XOR 2
+#define REQUEST_MODE_STREAM 3
+#define REQUEST_MODE_SHARED_MEMORY 4
+#define REQUEST_MODE_BATCH 5
+#define REQUEST_MODE_COMPRESSED_STREAM 6
 
-//character used to terminate cipher key and message strings
-#define DATA_TERMINATING_CHAR '\n'
+//largest shared memory client can send
+#define MAX_SHARED_MEMORY_SIZE 1073741824L
+
+//listening sockets passed to a new server are numbered from here, in the same order as the
+//command-line arguments (tcp, then unix domain socket), with their count in the LISTEN_FDS environment variable
+//and the new server's process id in LISTEN_PID, the same way as systemd socket activation
+#define INHERITED_SOCKET_START 3
+
+//environment variable with the file descriptor a new server writes one byte to once it is ready to accept connections
+//the old server keeps its listening sockets open until then, so a new server that fails to start doesn't stop the service
+#define READY_FILE_DESCRIPTOR_VARIABLE "OTP_READY_FD"
+
+//longest time an old server waits for a new server to be ready before it gives up and keeps accepting connections
+#ifndef RESTART_TIMEOUT_MILLISECONDS
+#define RESTART_TIMEOUT_MILLISECONDS 10000
+#endif
 
 
 /*
@@ -39,13 +105,16 @@
 //string used to represent client is the correct one
 //should be sent as first message from client
 #ifndef ACCEPTED_MESSAGE_HEADER
-#define ACCEPTED_MESSAGE_HEADER "ENCODE\n"
-//number of chars including null char in header
-#define ACCEPTED_MESSAGE_HEADER_LENGTH 8
+#define ACCEPTED_MESSAGE_HEADER ENCODE_MESSAGE_HEADER
+#endif
+
+#ifndef MESSAGE_TRANSFORMATION_FUNCTION_POINTER
+#define MESSAGE_TRANSFORMATION_FUNCTION_POINTER &otpEncode
 #endif
 
-#ifndef CHARACTER_TRANSFORMATION_FUNCTION_POINTER
-#define CHARACTER_TRANSFORMATION_FUNCTION_POINTER &encodeCharacter 
+//1 if results sent to the client are plaintext, so they are compressed in compressed stream mode
+#ifndef IS_RESULT_PLAINTEXT
+#define IS_RESULT_PLAINTEXT 0
 #endif
 
 /*
@@ -53,7 +122,9 @@
  */
 //prints program usage
 void printUsage(char *programName){
-  fprintf(stderr, "usage: %s <port> &\n", programName);
+  fprintf(stderr, "usage: %s <port> [<unix_socket_path>] &\n", programName);
+  fprintf(stderr, "send SIGHUP to restart from the program file without closing the listening sockets\n");
+  fprintf(stderr, "send SIGTERM to stop accepting connections and exit once open connections are finished\n");
 }
 
 //prints error message and exits program with error code
@@ -76,10 +147,11 @@ int isPortNumValid(int portNum){
 }
 
 //Validates command-line arguments for port number to listen on
+//and optional unix domain socket path, which is argv[2]
 //returns port number to listen on
 //based on: http://www.cs.cmu.edu/afs/cs/academic/class/15213-f99/www/class26/tcpserver.c
 int validateCommandLineArguments(int argc, char **argv){
-  if(argc != 2){
+  if(argc != 2 && argc != 3){
     printUsage(argv[0]);
     exit(1);
   }
@@ -144,202 +216,271 @@ int initializeServer(int portNum){
   return serverSocketFileDescriptor;
 }
 
+//starts the server listening on unix domain socket at socketPath, for clients on the same computer
+//returns fileDescriptor for the listening socket
+int initializeUnixServer(char *socketPath){
+  int serverSocketFileDescriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (serverSocketFileDescriptor < 0){
+    error("ERROR opening unix domain socket");
+  }
+
+  struct sockaddr_un serverAddress;
+  bzero((char *) &serverAddress, sizeof(serverAddress));
+  serverAddress.sun_family = AF_UNIX;
+  if(strlen(socketPath) >= sizeof(serverAddress.sun_path)){
+    fprintf(stderr, "Unix socket path %s is too long\n", socketPath);
+    exit(1);
+  }
+  strcpy(serverAddress.sun_path, socketPath);
+  //remove socket left behind by previous server, the same as SO_REUSEADDR for tcp
+  unlink(socketPath);
+
+  if(bind(serverSocketFileDescriptor, (struct sockaddr *) &serverAddress, sizeof(serverAddress)) < 0){
+    fprintf(stderr, "Could not bind to %s\n", socketPath);
+    exit(1);
+  }
+  if(listen(serverSocketFileDescriptor, REQUEST_QUEUE_SIZE) < 0){
+    error("ERROR on listen");
+  }
+  return serverSocketFileDescriptor;
+}
+
+//gets number of listening sockets passed to this process by a previous server or systemd
+//variables are removed, so connection processes don't mistake them for their own
+//returns number of sockets starting at INHERITED_SOCKET_START, or 0 if none were passed
+int getInheritedSocketCount(void){
+  char *processIdString = getenv("LISTEN_PID");
+  char *socketCountString = getenv("LISTEN_FDS");
+  int socketCount = 0;
+  //sockets are only meant for the process they were passed to
+  if(processIdString != NULL && socketCountString != NULL && atol(processIdString) == (long)getpid()){
+    socketCount = atoi(socketCountString);
+  }
+  unsetenv("LISTEN_PID");
+  unsetenv("LISTEN_FDS");
+  return socketCount > 0 ? socketCount : 0;
+}
+
 /*
 * Helper functions for reading/writing to sockets
 */
 //sends message to client identified by file descriptor
 void sendToSocket(int clientSocketFileDescriptor, char *message){
-  //send message to client
-  int charCountTransferred = write(clientSocketFileDescriptor, message, strlen(message));
-  //check for errors writing
-  if(charCountTransferred < 0){
+  //send message to client, looping until all of it is written
+  if(writeAllToSocket(clientSocketFileDescriptor, message, strlen(message)) < 0){
     error("ERROR writing to socket");
   }
 }
 
-//reads message from client identified by file descriptor and puts message into 
-//buffer supplied as second argument
-//based on: http://www.cs.cmu.edu/afs/cs/academic/class/15213-f99/www/class26/tcpserver.c
-void readFromSocketIntoBuffer(int clientSocketFileDescriptor, char *messageBuffer, int bufferSize){
-    //zero the buffer so that old messages do not remain
-    bzero(messageBuffer, bufferSize);
-    //store message from client in buffer
-    int charCountTransferred = read(clientSocketFileDescriptor, messageBuffer, bufferSize);
-    //check for errors reading
-    assert(charCountTransferred >= 0);
-}
-
 
 /*
 * Get data from client functions
 */
 
-//allocates memory for string buffer to store one time pad or message
-char * createBuffer(int bufferSize){
-  //allocate memory
-  char *buffer = malloc(sizeof(char) * bufferSize);
-  //check that memory allocation succeeded
-  assert(buffer != NULL);
-  //initialize memory with null chars
-  bzero(buffer, bufferSize);
-  return buffer;
-}
-
-//removes trailing '\n' char from string
-void chompString(char* message){
-  int length = strlen(message);
-  //check to make sure buffer has length first
-  if(length == 0){
-    return;
+//buffer for one time pad or message that starts out using its own small space
+//and is only allocated when a request needs more than that
+typedef struct MessageBuffer{
+  char *data;
+  //number of bytes data can hold
+  size_t capacity;
+  char smallData[SMALL_MESSAGE_BUFFER_SIZE];
+} MessageBuffer;
+
+//sets buffer to use its own small space
+void initializeMessageBuffer(MessageBuffer *buffer){
+  buffer->data = buffer->smallData;
+  buffer->capacity = SMALL_MESSAGE_BUFFER_SIZE;
+}
+
+//makes sure buffer can hold at least capacity bytes, keeping data already in it
+//memory isn't cleared first, since only data received from the client is used
+//returns 1 on success, or 0 if memory could not be allocated, in which case buffer is unchanged
+int reserveMessageBuffer(MessageBuffer *buffer, size_t capacity){
+  if(capacity <= buffer->capacity){
+    return 1;
   }
-  //remove trailing '\n' by changing it to null char
-  if(message[length - 1] == '\n'){
-    message[length - 1] = '\0';
+  char *data;
+  if(buffer->data == buffer->smallData){
+    data = malloc(capacity);
+    if(data != NULL){
+      memcpy(data, buffer->smallData, SMALL_MESSAGE_BUFFER_SIZE);
+    }
+  }
+  else{
+    data = realloc(buffer->data, capacity);
+  }
+  if(data == NULL){
+    return 0;
+  }
+  buffer->data = data;
+  buffer->capacity = capacity;
+  return 1;
+}
+
+//frees memory allocated for a long request, so idle connections only keep their small space
+void releaseMessageBuffer(MessageBuffer *buffer){
+  if(buffer->data != buffer->smallData){
+    free(buffer->data);
   }
+  initializeMessageBuffer(buffer);
+}
+
+//parses number of bytes at the end of header
+//returns number of bytes, or -1 if it is not a valid length
+long getDeclaredLength(char *lengthString, long maxLength){
+  char *lengthEnd;
+  long length = strtol(lengthString, &lengthEnd, 10);
+  //length must be followed by terminator, and not be more than maximum
+  if(lengthEnd == lengthString || *lengthEnd != DATA_TERMINATING_CHAR || length <= 0 || length > maxLength){
+    return -1;
+  }
+  return length;
 }
 
 //receive message from sender and determine if it has the correct header
 //used so encode and decode clients do not connect to wrong servers
-//returns 1 if client is authorized, and 0 if not
+//returns REQUEST_MODE_TEXT, REQUEST_MODE_XOR, REQUEST_MODE_STREAM, REQUEST_MODE_COMPRESSED_STREAM, REQUEST_MODE_SHARED_MEMORY or REQUEST_MODE_BATCH
+//if client is authorized, and REQUEST_MODE_UNAUTHORIZED if not, or REQUEST_MODE_CLOSED if client closed the connection
+//for xor and shared memory modes, number of bytes is stored in declaredLength, and for batch mode, number of requests
 //will send error message to client if it is unauthorized
-int isClientAuthorized(int clientSocketFileDescriptor){
-  char *message = createBuffer(ACCEPTED_MESSAGE_HEADER_LENGTH);
-  //read message sent from client
-  readFromSocketIntoBuffer(clientSocketFileDescriptor, message, ACCEPTED_MESSAGE_HEADER_LENGTH);
-  //compare message with correct message header
-  int compareValue = strcmp(message, ACCEPTED_MESSAGE_HEADER);
-  //free memory from message before returning
-  free(message);
-  //check if client is authorized and return message if not
-  if(compareValue != 0){
-    sendToSocket(clientSocketFileDescriptor, "ERROR: Client not authorized to connect to this server\n");
-    return 0;
+int getRequestMode(BufferedConnection *connection, long *declaredLength){
+  char message[HEADER_BUFFER_SIZE];
+  //read message sent from client - header is terminated the same way as data
+  ssize_t messageLength = readFromSocketUntilTerminator(connection, message, HEADER_BUFFER_SIZE, DATA_TERMINATING_CHAR);
+  if(messageLength == SOCKET_IO_CLOSED || messageLength == SOCKET_IO_ERROR){
+    return REQUEST_MODE_CLOSED;
   }
-  return 1;
-}
-
-//returns 1 if data has finished being sent, and 0 if not
-//uses presence of control character at the end of the string to know if
-//data is finished
-int isDataComplete(char *data){
-  //sanity check first
-  assert(data != NULL);
-  //get length, since we need to check last character
-  int length = strlen(data);
-  //check to see if data is empty, since data must have length
-  if(length <= 0){
-    return 0;
+  if(messageLength >= 0 && strcmp(message, ACCEPTED_MESSAGE_HEADER) == 0){
+    return REQUEST_MODE_TEXT;
+  }
+  //stream header is accepted header without its terminator, followed by stream suffix
+  int acceptedHeaderLength = strlen(ACCEPTED_MESSAGE_HEADER) - 1;
+  if(messageLength >= 0 && strncmp(message, ACCEPTED_MESSAGE_HEADER, acceptedHeaderLength) == 0 && strcmp(message + acceptedHeaderLength, STREAM_MESSAGE_HEADER_SUFFIX) == 0){
+    return REQUEST_MODE_STREAM;
+  }
+  if(messageLength >= 0 && strncmp(message, ACCEPTED_MESSAGE_HEADER, acceptedHeaderLength) == 0 && strcmp(message + acceptedHeaderLength, COMPRESSED_STREAM_MESSAGE_HEADER_SUFFIX) == 0){
+    return REQUEST_MODE_COMPRESSED_STREAM;
+  }
+  if(messageLength >= 0 && strncmp(message, XOR_MESSAGE_HEADER_PREFIX, strlen(XOR_MESSAGE_HEADER_PREFIX)) == 0){
+    *declaredLength = getDeclaredLength(message + strlen(XOR_MESSAGE_HEADER_PREFIX), MAX_XOR_MESSAGE_SIZE);
+    if(*declaredLength > 0){
+      return REQUEST_MODE_XOR;
+    }
+  }
+  int sharedMemoryHeaderLength = acceptedHeaderLength + strlen(SHARED_MEMORY_MESSAGE_HEADER_SUFFIX);
+  if(messageLength >= 0 && strncmp(message, ACCEPTED_MESSAGE_HEADER, acceptedHeaderLength) == 0 && strncmp(message + acceptedHeaderLength, SHARED_MEMORY_MESSAGE_HEADER_SUFFIX, strlen(SHARED_MEMORY_MESSAGE_HEADER_SUFFIX)) == 0){
+    *declaredLength = getDeclaredLength(message + sharedMemoryHeaderLength, MAX_SHARED_MEMORY_SIZE);
+    if(*declaredLength > 0){
+      return REQUEST_MODE_SHARED_MEMORY;
+    }
+  }
+  int batchHeaderLength = acceptedHeaderLength + strlen(BATCH_MESSAGE_HEADER_SUFFIX);
+  if(messageLength >= 0 && strncmp(message, ACCEPTED_MESSAGE_HEADER, acceptedHeaderLength) == 0 && strncmp(message + acceptedHeaderLength, BATCH_MESSAGE_HEADER_SUFFIX, strlen(BATCH_MESSAGE_HEADER_SUFFIX)) == 0){
+    *declaredLength = getDeclaredLength(message + batchHeaderLength, MAX_BATCH_REQUEST_COUNT);
+    if(*declaredLength > 0){
+      return REQUEST_MODE_BATCH;
+    }
   }
-  //check last char
-  return data[length - 1] == DATA_TERMINATING_CHAR;
+  //client is not authorized, so send error message
+  sendToSocket(connection->fileDescriptor, "ERROR: Client not authorized to connect to this server\n");
+  return REQUEST_MODE_UNAUTHORIZED;
 }
 
 //checks that key is the same length or longer than message
 //returns 1 if true, 0 if false
-int isValidKeyLength(char *key, char *message){
-  int keyLength = strlen(key);
-  int messageLength = strlen(message);
-
+int isValidKeyLength(int keyLength, int messageLength){
   return keyLength >= messageLength;
 }
 
+//gets data terminated by \n from client, and saves it in data argument starting at dataStart
+//buffer is doubled each time it fills up, up to MESSAGE_BUFFER_SIZE, so long data is only copied a few times
+//returns length of data, including the \n char, or -1 if data could not be received or stored
+int appendDataFromClient(BufferedConnection *connection, MessageBuffer *data, size_t dataStart){
+  size_t dataFill = dataStart;
+  while(1){
+    ssize_t dataLength = readFromSocketUntilTerminator(connection, data->data + dataFill, data->capacity - dataFill, DATA_TERMINATING_CHAR);
+    if(dataLength >= 0){
+      dataFill += dataLength;
+      break;
+    }
+    if(dataLength != SOCKET_IO_OVERFLOW || data->capacity >= MESSAGE_BUFFER_SIZE){
+      return -1;
+    }
+    //everything but the space for the null char was filled
+    dataFill = data->capacity - 1;
+    if(!reserveMessageBuffer(data, data->capacity * 2 < MESSAGE_BUFFER_SIZE ? data->capacity * 2 : MESSAGE_BUFFER_SIZE)){
+      return -1;
+    }
+  }
+  return dataFill - dataStart;
+}
+
 //gets data from client using socket, and saves in data argument
 //data should end in \n char, and since that should be the only
 //newline char in the string, we will know that receiving from the client is 
 //done
-void getDataFromClient(int clientSocketFileDescriptor, char *data){
-  //use while loop to receive data, since it might take multiple requests
-  //specifically do-while, since we need it to run at least one time
-  
-  //create variables so new data gets added to end of buffer
-  //subtract one from buffer size to allow for null char at end
-  int bufferSize = MESSAGE_BUFFER_SIZE - 1;
-  char *dataCurrentPointer = data;
-  do{
-    int charCountTransferred = read(clientSocketFileDescriptor, dataCurrentPointer, bufferSize);
-    //check that read succeeded
-    assert(charCountTransferred >= 0);
-    //modify variables so new data gets added on to the end
-    bufferSize -= charCountTransferred;
-    dataCurrentPointer += charCountTransferred;
-
-  }while(!isDataComplete(data) && bufferSize > 0);
-
+//trailing \n is removed from data
+//returns length of data, or -1 if data could not be received
+int getDataFromClient(BufferedConnection *connection, MessageBuffer *data){
+  int dataLength = appendDataFromClient(connection, data, 0);
+  if(dataLength < 0){
+    return -1;
+  }
+  //remove trailing '\n' by changing it to null char
+  data->data[dataLength - 1] = '\0';
+  return dataLength - 1;
 }
 
 
 /*
-* Character encoding/decoding functions
+* Message encoding/decoding functions
 */
 
-//normalizes ASCII A-Z and space to int from
-//0-26 (base 27), with 0 being A and 26 being space
-int charToBase27(char c){
-  //sanity check for character
-  assert(c == ' ' || isupper(c));
-  //check for space character
-  if(c == ' '){
-    return 26;
-  }
-  //A is ASCII character 65
-  int offset = 65;
-  return c - offset;
-}
-
-//reverse of charToBase27
-//converts base 27 number to ASCII char
-//A-Z or space (26 is space char, 0 is A)
-char base27ToChar(int d){
-  //sanity check for range
-  assert(d >= 0 && d <= 26);
-  if(d == 26){
-    return ' ';
-  }
-  int offset = 65;
-  return d + offset;
-}
-
-//encodes a character A-Z or space with key char
-//normalizes offset on ASCII character codes first
-//by adding them together and performing mod % 27 on result
-//returns encoded character
-char encodeCharacter(char messageChar, char keyChar){
-  //convert to base 27 versions
-  int base27MessageChar = charToBase27(messageChar);
-  int base27keyChar = charToBase27(keyChar);
-  //add together, perform modulo so still base 27, and convert to character
-  return base27ToChar((base27MessageChar + base27keyChar) % 27);
-}
-
-//decodes a character A-Z or space with key char
-//by subtracting key from encoded message and performing mod % 27 on result
-//returns encoded character
-//with normalized offset for ASCII character codes
-char decodeCharacter(char messageChar, char keyChar){
-  //convert to base 27 versions
-  int base27MessageChar = charToBase27(messageChar);
-  int base27keyChar = charToBase27(keyChar);
-  //subtract key from message, perform modulo so still base 27, and convert to character
-  int difference = (base27MessageChar - base27keyChar) % 27;
-  //need add encoding base if difference is less than 0
-  difference = difference >= 0 ? difference : difference + 27;
-  return base27ToChar(difference);
-}
+//messages at least this long are transformed by workerPool, set once when the server starts
+long parallelTransformThreshold = PARALLEL_TRANSFORM_THRESHOLD;
+//number of threads used for long messages, which is the number of processors when the server started
+int transformThreadCount = 1;
+//threads that transform long messages for this connection process
+//started by the first long message, and kept until the connection closes, so later long requests and chunks reuse them
+//each connection is a separate process, so threads can't be shared between connections
+OtpWorkerPool *workerPool = NULL;
 
+//reads parallel transform settings when the server starts, so they aren't looked up for every message
+//exits with error if threshold in environment isn't a positive number
+void loadTransformSettings(void){
+  transformThreadCount = sysconf(_SC_NPROCESSORS_ONLN);
+  if(transformThreadCount < 1){
+    transformThreadCount = 1;
+  }
+  char *thresholdString = getenv(PARALLEL_TRANSFORM_THRESHOLD_VARIABLE);
+  if(thresholdString == NULL){
+    return;
+  }
+  char *thresholdEnd;
+  errno = 0;
+  parallelTransformThreshold = strtol(thresholdString, &thresholdEnd, 10);
+  if(errno != 0 || thresholdEnd == thresholdString || *thresholdEnd != '\0' || parallelTransformThreshold <= 0){
+    fprintf(stderr, "%s must be a positive number of characters\n", PARALLEL_TRANSFORM_THRESHOLD_VARIABLE);
+    exit(1);
+  }
+}
 
 //modify message in place, character by character using key
 //whether this encodes or decodes message depends on constant definition
 //at top of file, as both encoding and decoding files use the same code
-void modifyMessage(char *message, char *key, char (*characterTransformationFunction)(char, char)){
-  int messageLength = strlen(message);
-  int i;
-  //modify every character in message using key and transformation function
-  for(i = 0; i < messageLength; ++i){
-    message[i] = characterTransformationFunction(message[i], key[i]);
+//long messages are transformed using one thread per processor
+//returns 1 if message was modified, or 0 if message or key contain invalid characters
+int modifyMessage(char *message, int messageLength, char *key, OtpTransformFunction transformationFunction){
+  if(messageLength < parallelTransformThreshold || transformThreadCount == 1){
+    return transformationFunction(message, key, message, messageLength) == 0;
   }
-  //add terminating character to end of message
-  message[messageLength] = DATA_TERMINATING_CHAR;
-
+  if(workerPool == NULL){
+    workerPool = otpWorkerPoolCreate(transformThreadCount);
+  }
+  if(workerPool == NULL){
+    return transformationFunction(message, key, message, messageLength) == 0;
+  }
+  return otpWorkerPoolTransform(workerPool, transformationFunction, message, key, message, messageLength) == 0;
 }
 
 /*
@@ -350,50 +491,630 @@ void modifyMessage(char *message, char *key, char (*characterTransformationFunct
 * This program encodes message
 */
 
-void mainServerAction(int clientSocketFileDescriptor){
-  //check if client is authorized
-  if(!isClientAuthorized(clientSocketFileDescriptor)){
-    return;
-  }
-  //allocate memory to store message to be encoded
-  char *message = createBuffer(MESSAGE_BUFFER_SIZE);
-  //allocate memory to store cipher key
-  char *key = createBuffer(MESSAGE_BUFFER_SIZE);
+//encodes or decodes text message terminated by \n using key terminated by \n
+//returns 1 if client can send another request on the same connection, or 0 if data could not be received
+int handleTextRequest(BufferedConnection *connection, MessageBuffer *keyBuffer, MessageBuffer *messageBuffer){
+  int clientSocketFileDescriptor = connection->fileDescriptor;
   //send ok message to let client know to send key
   sendToSocket(clientSocketFileDescriptor, OK_MESSAGE);
 
   //client should now send key, so read that, and save in key variable
-  getDataFromClient(clientSocketFileDescriptor, key);
-  //remove trailing newline
-  chompString(key);
+  int keyLength = getDataFromClient(connection, keyBuffer);
 
   //send ok message to let client know to send message
-  sendToSocket(clientSocketFileDescriptor, OK_MESSAGE);
+  //valid message is no longer than key, so make room for that much, plus terminator and null char, up front
+  if(keyLength >= 0 && !reserveMessageBuffer(messageBuffer, keyLength + 2 < MESSAGE_BUFFER_SIZE ? keyLength + 2 : MESSAGE_BUFFER_SIZE)){
+    sendToSocket(clientSocketFileDescriptor, "@ERROR: Server is out of memory\n");
+    return 0;
+  }
+  if(keyLength >= 0){
+    sendToSocket(clientSocketFileDescriptor, OK_MESSAGE);
+  }
 
   //get message from client
-  getDataFromClient(clientSocketFileDescriptor, message);
-  //remove trailing newline
-  chompString(message);
+  int messageLength = keyLength >= 0 ? getDataFromClient(connection, messageBuffer) : -1;
+  char *message = messageBuffer->data;
+  char *key = keyBuffer->data;
 
   //check that key is the same length or longer than message
   //send error message to client and exit if not
-  if(!isValidKeyLength(key, message)){
+  if(messageLength < 0){
+    sendToSocket(clientSocketFileDescriptor, "@ERROR: Could not receive data\n");
+  }
+  else if(!isValidKeyLength(keyLength, messageLength)){
     sendToSocket(clientSocketFileDescriptor, "@ERROR: Key is shorter than message\n");
-    //free memory from buffers
-    free(message);
-    free(key);
-    return;
-  } 
-
+  }
   //modify message to either be encoded or decoded as appropriate, based on constant defined in header
-  modifyMessage(message, key, CHARACTER_TRANSFORMATION_FUNCTION_POINTER);
+  else if(!modifyMessage(message, messageLength, key, MESSAGE_TRANSFORMATION_FUNCTION_POINTER)){
+    sendToSocket(clientSocketFileDescriptor, "@ERROR: Key or message contains invalid characters\n");
+  }
+  //send modified message to client with terminator in the same write
+  else if(writeToSocketWithTerminator(clientSocketFileDescriptor, message, messageLength, DATA_TERMINATING_CHAR) < 0){
+    error("ERROR writing to socket");
+  }
+
+  return messageLength >= 0;
+}
+
+//semaphore counting units of XOR_MEMORY_UNIT_SIZE that xor requests can still use, shared by all connection processes
+//or -1 if it couldn't be created, in which case xor memory isn't limited
+int xorMemorySemaphore = -1;
+
+//creates semaphore for limiting memory used by xor requests with all of MAX_XOR_MEMORY_IN_FLIGHT available
+void createXorMemorySemaphore(void){
+  xorMemorySemaphore = semget(IPC_PRIVATE, 1, IPC_CREAT | 0600);
+  if(xorMemorySemaphore >= 0 && semctl(xorMemorySemaphore, 0, SETVAL, (int)(MAX_XOR_MEMORY_IN_FLIGHT / XOR_MEMORY_UNIT_SIZE)) < 0){
+    semctl(xorMemorySemaphore, 0, IPC_RMID);
+    xorMemorySemaphore = -1;
+  }
+  if(xorMemorySemaphore < 0){
+    perror("Could not limit memory used by xor requests");
+  }
+}
+
+//waits until size bytes of xor memory are available, and takes them
+//undone by the operating system if the process exits first, so memory of a connection that fails isn't lost
+//returns number of units taken, which should be passed to releaseXorMemory
+int reserveXorMemory(long size){
+  int unitCount = (size + XOR_MEMORY_UNIT_SIZE - 1) / XOR_MEMORY_UNIT_SIZE;
+  //request bigger than the whole limit waits for all of it
+  if(unitCount > MAX_XOR_MEMORY_IN_FLIGHT / XOR_MEMORY_UNIT_SIZE){
+    unitCount = MAX_XOR_MEMORY_IN_FLIGHT / XOR_MEMORY_UNIT_SIZE;
+  }
+  struct sembuf operation = {0, -unitCount, SEM_UNDO};
+  int result = -1;
+  while(xorMemorySemaphore >= 0 && (result = semop(xorMemorySemaphore, &operation, 1)) < 0 && errno == EINTR){
+  }
+  //nothing is taken if there is no limit
+  return result == 0 ? unitCount : 0;
+}
+
+//gives back units of xor memory taken by reserveXorMemory
+void releaseXorMemory(int unitCount){
+  struct sembuf operation = {0, unitCount, SEM_UNDO};
+  if(unitCount > 0){
+    semop(xorMemorySemaphore, &operation, 1);
+  }
+}
+
+//combines length bytes of message with length bytes of key using exclusive or
+//key is sent first, followed by message, and result is sent back without a terminator
+//returns 1 if client can send another request on the same connection, or 0 if data could not be received
+int handleXorRequest(BufferedConnection *connection, long length, MessageBuffer *keyBuffer, MessageBuffer *messageBuffer){
+  int clientSocketFileDescriptor = connection->fileDescriptor;
+  //length is known, so buffers don't need to be any bigger than that
+  int xorMemoryUnitCount = reserveXorMemory(2 * length);
+  if(!reserveMessageBuffer(keyBuffer, length) || !reserveMessageBuffer(messageBuffer, length)){
+    releaseMessageBuffer(keyBuffer);
+    releaseXorMemory(xorMemoryUnitCount);
+    sendToSocket(clientSocketFileDescriptor, "@ERROR: Server is out of memory\n");
+    return 0;
+  }
+  char *key = keyBuffer->data;
+  char *message = messageBuffer->data;
+  //send ok message to let client know to send key and message
+  sendToSocket(clientSocketFileDescriptor, OK_MESSAGE);
+
+  int isReceived = readFromSocketExactly(connection, key, length) >= 0 && readFromSocketExactly(connection, message, length) >= 0;
+  if(!isReceived){
+    sendToSocket(clientSocketFileDescriptor, "@ERROR: Could not receive data\n");
+  }
+  else{
+    //every byte value is valid, so this can't fail
+    modifyMessage(message, length, key, &otpXor);
+    if(writeAllToSocket(clientSocketFileDescriptor, message, length) < 0){
+      error("ERROR writing to socket");
+    }
+  }
+
+  //memory is given back as soon as the request is finished, so other connections can use it
+  releaseMessageBuffer(keyBuffer);
+  releaseMessageBuffer(messageBuffer);
+  releaseXorMemory(xorMemoryUnitCount);
+  return isReceived;
+}
+
+//gets length of next chunk in stream mode from client
+//in compressed stream mode, messageDataLength is set to the length of message data sent for the chunk,
+//which is never more than the chunk length, otherwise it is NULL
+//returns length, which is 0 at end of stream, or -1 if it could not be received or is invalid
+long getStreamChunkLength(BufferedConnection *connection, long *messageDataLength){
+  char lengthString[HEADER_BUFFER_SIZE];
+  if(readFromSocketUntilTerminator(connection, lengthString, HEADER_BUFFER_SIZE, DATA_TERMINATING_CHAR) < 0){
+    return -1;
+  }
+  char *lengthEnd;
+  long length = strtol(lengthString, &lengthEnd, 10);
+  if(lengthEnd == lengthString || length < 0 || length > STREAM_CHUNK_SIZE){
+    return -1;
+  }
+  if(messageDataLength != NULL){
+    char *dataLengthString = lengthEnd;
+    *messageDataLength = strtol(dataLengthString, &lengthEnd, 10);
+    if(lengthEnd == dataLengthString || *messageDataLength < 0 || *messageDataLength > length || (length > 0 && *messageDataLength == 0)){
+      return -1;
+    }
+  }
+  if(*lengthEnd != DATA_TERMINATING_CHAR){
+    return -1;
+  }
+  return length;
+}
+
+//receives message data for a chunk of chunkLength characters in compressed stream mode into message
+//compressedData must have space for chunkLength characters
+//returns 1 if message was received, or 0 if it could not be received or decompressed
+int getCompressedStreamMessage(BufferedConnection *connection, char *message, long chunkLength, long messageDataLength, char *compressedData){
+  if(messageDataLength == chunkLength){
+    return readFromSocketExactly(connection, message, chunkLength) >= 0;
+  }
+  if(readFromSocketExactly(connection, compressedData, messageDataLength) < 0){
+    return 0;
+  }
+  return otpDecompress(compressedData, messageDataLength, message, chunkLength) == chunkLength;
+}
+
+//sends transformed chunk in compressed stream mode, after a line with the length of its data
+//result is compressed into compressedData, which must have space for chunkLength characters, if results are plaintext
+//and it makes them shorter, otherwise it is sent as it is
+//returns 0 on success, or -1 on error
+int sendCompressedStreamResult(int clientSocketFileDescriptor, char *result, long chunkLength, char *compressedData){
+  char *resultData = result;
+  size_t resultDataLength = chunkLength;
+  if(IS_RESULT_PLAINTEXT){
+    size_t compressedLength = otpCompress(result, chunkLength, compressedData, chunkLength - 1);
+    if(compressedLength > 0){
+      resultData = compressedData;
+      resultDataLength = compressedLength;
+    }
+  }
+  char lengthString[HEADER_BUFFER_SIZE];
+  struct iovec vectors[2];
+  vectors[0].iov_base = lengthString;
+  vectors[0].iov_len = snprintf(lengthString, HEADER_BUFFER_SIZE, "%zu\n", resultDataLength);
+  vectors[1].iov_base = resultData;
+  vectors[1].iov_len = resultDataLength;
+  return writeVectorsToSocket(clientSocketFileDescriptor, vectors, 2);
+}
+
+//encodes or decodes message sent in chunks, each chunk of key followed by the same length chunk of message
+//each chunk is sent back as soon as it is transformed, without a terminator, so memory used doesn't depend on message length
+//in compressed stream mode, plaintext is compressed, and results are sent after a line with their length
+//valid results never contain '@', so errors are sent as a line starting with '@' and the connection is closed
+//returns 1 if client can send another request on the same connection, or 0 if there was an error
+int handleStreamRequest(BufferedConnection *connection, MessageBuffer *keyBuffer, MessageBuffer *messageBuffer, int isCompressed){
+  int clientSocketFileDescriptor = connection->fileDescriptor;
+  //compressed data is never longer than a chunk, since data that doesn't get shorter is sent as it is
+  char *compressedData = NULL;
+  if(isCompressed){
+    compressedData = malloc(STREAM_CHUNK_SIZE);
+    assert(compressedData != NULL);
+  }
+  //send ok message to let client know to start sending chunks
+  sendToSocket(clientSocketFileDescriptor, OK_MESSAGE);
+
+  int isConnectionUsable = 1;
+  long chunkLength;
+  long messageDataLength;
+  while((chunkLength = getStreamChunkLength(connection, isCompressed ? &messageDataLength : NULL)) > 0){
+    //buffers only grow as big as the longest chunk
+    if(!reserveMessageBuffer(keyBuffer, chunkLength) || !reserveMessageBuffer(messageBuffer, chunkLength)){
+      sendToSocket(clientSocketFileDescriptor, "@ERROR: Server is out of memory\n");
+      isConnectionUsable = 0;
+      break;
+    }
+    char *key = keyBuffer->data;
+    char *message = messageBuffer->data;
+    int isReceived = readFromSocketExactly(connection, key, chunkLength) >= 0;
+    if(isReceived && isCompressed){
+      isReceived = getCompressedStreamMessage(connection, message, chunkLength, messageDataLength, compressedData);
+    }
+    else if(isReceived){
+      isReceived = readFromSocketExactly(connection, message, chunkLength) >= 0;
+    }
+    if(!isReceived){
+      sendToSocket(clientSocketFileDescriptor, "@ERROR: Could not receive data\n");
+      isConnectionUsable = 0;
+      break;
+    }
+    if(!modifyMessage(message, chunkLength, key, MESSAGE_TRANSFORMATION_FUNCTION_POINTER)){
+      sendToSocket(clientSocketFileDescriptor, "@ERROR: Key or message contains invalid characters\n");
+      isConnectionUsable = 0;
+      break;
+    }
+    int writeResult = isCompressed ? sendCompressedStreamResult(clientSocketFileDescriptor, message, chunkLength, compressedData) : writeAllToSocket(clientSocketFileDescriptor, message, chunkLength);
+    if(writeResult < 0){
+      error("ERROR writing to socket");
+    }
+  }
+  if(chunkLength < 0){
+    sendToSocket(clientSocketFileDescriptor, "@ERROR: Invalid chunk length\n");
+    isConnectionUsable = 0;
+  }
+
+  free(compressedData);
+  return isConnectionUsable;
+}
+
+//key and message of one request in batch mode, as offsets in the batch's key and message buffers
+//since buffers can move as they grow while the batch is received
+typedef struct BatchRequest{
+  size_t keyOffset;
+  size_t messageOffset;
+  int keyLength;
+  int messageLength;
+} BatchRequest;
+
+//encodes or decodes requestCount text messages, each sent as a key line followed by a message line
+//all keys and messages are received into two contiguous buffers and transformed back to back,
+//then results are sent one per line in a single write, with error messages in place of results that failed
+//returns 1 if client can send another request on the same connection, or 0 if data could not be received
+int handleBatchRequest(BufferedConnection *connection, long requestCount, MessageBuffer *keyBuffer, MessageBuffer *messageBuffer){
+  int clientSocketFileDescriptor = connection->fileDescriptor;
+  BatchRequest *requests = malloc(sizeof(BatchRequest) * requestCount);
+  assert(requests != NULL);
+  //send ok message to let client know to send keys and messages
+  sendToSocket(clientSocketFileDescriptor, OK_MESSAGE);
+
+  size_t keyFill = 0;
+  size_t messageFill = 0;
+  long i;
+  for(i = 0; i < requestCount; ++i){
+    BatchRequest *request = &requests[i];
+    request->keyOffset = keyFill;
+    request->keyLength = appendDataFromClient(connection, keyBuffer, keyFill);
+    request->messageOffset = messageFill;
+    request->messageLength = request->keyLength >= 0 ? appendDataFromClient(connection, messageBuffer, messageFill) : -1;
+    if(request->messageLength < 0){
+      sendToSocket(clientSocketFileDescriptor, "@ERROR: Could not receive data\n");
+      free(requests);
+      return 0;
+    }
+    keyFill += request->keyLength;
+    messageFill += request->messageLength;
+    //lengths don't include terminators, which stay in the buffers, so each transformed message is already a result line
+    request->keyLength--;
+    request->messageLength--;
+  }
+
+  //results are sent straight from the message buffer, and vectors only break them up around errors
+  //so a batch without errors is sent with one vector
+  struct iovec *vectors = malloc(sizeof(struct iovec) * (2 * requestCount + 1));
+  assert(vectors != NULL);
+  int vectorCount = 0;
+  vectors[0] = (struct iovec){messageBuffer->data, 0};
+  for(i = 0; i < requestCount; ++i){
+    BatchRequest *request = &requests[i];
+    char *message = messageBuffer->data + request->messageOffset;
+    char *errorMessage = NULL;
+    if(!isValidKeyLength(request->keyLength, request->messageLength)){
+      errorMessage = "@ERROR: Key is shorter than message\n";
+    }
+    else if(!modifyMessage(message, request->messageLength, keyBuffer->data + request->keyOffset, MESSAGE_TRANSFORMATION_FUNCTION_POINTER)){
+      errorMessage = "@ERROR: Key or message contains invalid characters\n";
+    }
+    if(errorMessage == NULL){
+      vectors[vectorCount].iov_len += request->messageLength + 1;
+      continue;
+    }
+    vectors[++vectorCount] = (struct iovec){errorMessage, strlen(errorMessage)};
+    vectors[++vectorCount] = (struct iovec){message + request->messageLength + 1, 0};
+  }
+  if(writeVectorsToSocket(clientSocketFileDescriptor, vectors, vectorCount + 1) < 0){
+    error("ERROR writing to socket");
+  }
+
+  free(vectors);
+  free(requests);
+  return 1;
+}
+
+//parses shared memory request line of the form <message_offset> <key_offset> <length>
+//and checks that message and key are inside shared memory of sharedMemorySize bytes
+//returns 1 if request is valid, otherwise 0
+int getSharedMemoryRequest(char *line, size_t sharedMemorySize, size_t *messageOffset, size_t *keyOffset, size_t *length){
+  char *end;
+  *messageOffset = strtoul(line, &end, 10);
+  *keyOffset = strtoul(end, &end, 10);
+  *length = strtoul(end, &end, 10);
+  if(*end != DATA_TERMINATING_CHAR){
+    return 0;
+  }
+  //subtract instead of adding, so large values can't overflow
+  return *messageOffset <= sharedMemorySize && *length <= sharedMemorySize - *messageOffset &&
+    *keyOffset <= sharedMemorySize && *length <= sharedMemorySize - *keyOffset;
+}
+
+//waits until client sends more data, or the server stops so connection should be closed
+//data already sent by the client is handled first, so requests that were sent aren't dropped
+//drainFileDescriptor is the read end of a pipe that the server closes when it stops
+//returns 1 if request should be read, or 0 if connection should be closed
+int waitForNextRequest(BufferedConnection *connection, int drainFileDescriptor){
+  if(connection->readPosition < connection->readFill){
+    return 1;
+  }
+  struct pollfd waitingFileDescriptors[2] = {
+    {connection->fileDescriptor, POLLIN, 0},
+    {drainFileDescriptor, POLLIN, 0}
+  };
+  while(poll(waitingFileDescriptors, 2, -1) < 0){
+    if(errno != EINTR){
+      return 0;
+    }
+  }
+  return waitingFileDescriptors[0].revents != 0;
+}
+
+//gets shared memory file descriptor from client on unix domain socket, and transforms messages
+//in shared memory in place, sending ok message after each one, until client closes connection
+//or the server stops
+//returns 0, since shared memory mode lasts until the connection is closed
+int handleSharedMemoryRequest(BufferedConnection *connection, long sharedMemorySize, int drainFileDescriptor){
+  int clientSocketFileDescriptor = connection->fileDescriptor;
+  //send ok message to let client know to send file descriptor
+  sendToSocket(clientSocketFileDescriptor, OK_MESSAGE);
+
+  //client could send a smaller file than it declared, or shrink it later, so check it before mapping it
+  int sharedMemoryFileDescriptor = receiveFileDescriptor(connection);
+  char *sharedMemory = MAP_FAILED;
+  if(sharedMemoryFileDescriptor >= 0 && isSharedMemoryUsable(sharedMemoryFileDescriptor, sharedMemorySize)){
+    sharedMemory = mmap(NULL, sharedMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED, sharedMemoryFileDescriptor, 0);
+  }
+  if(sharedMemoryFileDescriptor >= 0){
+    close(sharedMemoryFileDescriptor);
+  }
+  if(sharedMemory == MAP_FAILED){
+    sendToSocket(clientSocketFileDescriptor, "@ERROR: Could not map shared memory\n");
+    return 0;
+  }
+  //send ok message to let client know shared memory is ready
+  sendToSocket(clientSocketFileDescriptor, OK_MESSAGE);
+
+  char line[HEADER_BUFFER_SIZE];
+  while(waitForNextRequest(connection, drainFileDescriptor) && readFromSocketUntilTerminator(connection, line, HEADER_BUFFER_SIZE, DATA_TERMINATING_CHAR) >= 0){
+    size_t messageOffset;
+    size_t keyOffset;
+    size_t length;
+    if(!getSharedMemoryRequest(line, sharedMemorySize, &messageOffset, &keyOffset, &length)){
+      sendToSocket(clientSocketFileDescriptor, "@ERROR: Invalid shared memory request\n");
+    }
+    else if(!modifyMessage(sharedMemory + messageOffset, length, sharedMemory + keyOffset, MESSAGE_TRANSFORMATION_FUNCTION_POINTER)){
+      sendToSocket(clientSocketFileDescriptor, "@ERROR: Key or message contains invalid characters\n");
+    }
+    else{
+      sendToSocket(clientSocketFileDescriptor, OK_MESSAGE);
+    }
+  }
 
-  //send modified message to client
-  sendToSocket(clientSocketFileDescriptor, message);
+  munmap(sharedMemory, sharedMemorySize);
+  return 0;
+}
 
-  //free memory from buffers
-  free(message);
-  free(key);
+//handles requests from client until it closes the connection
+//so clients can keep a connection open and send many requests without connecting each time
+//once the server stops, the connection is closed after the request in progress is finished
+void mainServerAction(int clientSocketFileDescriptor, int drainFileDescriptor){
+  //replies are small and sent all at once, so don't wait to fill packets
+  setSocketNoDelay(clientSocketFileDescriptor, 1);
+  //used to read from client, so that data sent together isn't lost between reads
+  BufferedConnection *connection = malloc(sizeof(BufferedConnection));
+  assert(connection != NULL);
+  initializeBufferedConnection(connection, clientSocketFileDescriptor);
+  //kept for the whole connection, so short requests never allocate memory
+  MessageBuffer *keyBuffer = malloc(sizeof(MessageBuffer));
+  MessageBuffer *messageBuffer = malloc(sizeof(MessageBuffer));
+  assert(keyBuffer != NULL && messageBuffer != NULL);
+  initializeMessageBuffer(keyBuffer);
+  initializeMessageBuffer(messageBuffer);
+
+  //check if client is authorized, and what kind of request it is making
+  //stop when connection is closed, client is unauthorized, or data isn't received correctly
+  //first request is always handled, since client may have connected just before the server stopped
+  int isConnectionUsable = 1;
+  int requestCount = 0;
+  while(isConnectionUsable && (requestCount++ == 0 || waitForNextRequest(connection, drainFileDescriptor))){
+    long declaredLength = 0;
+    switch(getRequestMode(connection, &declaredLength)){
+      case REQUEST_MODE_TEXT:
+        isConnectionUsable = handleTextRequest(connection, keyBuffer, messageBuffer);
+        break;
+      case REQUEST_MODE_XOR:
+        isConnectionUsable = handleXorRequest(connection, declaredLength, keyBuffer, messageBuffer);
+        break;
+      case REQUEST_MODE_SHARED_MEMORY:
+        isConnectionUsable = handleSharedMemoryRequest(connection, declaredLength, drainFileDescriptor);
+        break;
+      case REQUEST_MODE_STREAM:
+        isConnectionUsable = handleStreamRequest(connection, keyBuffer, messageBuffer, 0);
+        break;
+      case REQUEST_MODE_COMPRESSED_STREAM:
+        isConnectionUsable = handleStreamRequest(connection, keyBuffer, messageBuffer, 1);
+        break;
+      case REQUEST_MODE_BATCH:
+        isConnectionUsable = handleBatchRequest(connection, declaredLength, keyBuffer, messageBuffer);
+        break;
+      default:
+        isConnectionUsable = 0;
+        break;
+    }
+    releaseMessageBuffer(keyBuffer);
+    releaseMessageBuffer(messageBuffer);
+  }
+
+  otpWorkerPoolDestroy(workerPool);
+  workerPool = NULL;
+  free(messageBuffer);
+  free(keyBuffer);
+  free(connection);
+}
+
+
+
+/*
+ * Restarting and stopping
+ */
+
+//write end of pipe that signal handler uses to wake up the main server loop
+//a pipe is used instead of a flag, so a signal that arrives just before poll isn't missed
+int signalPipeWriteFileDescriptor = -1;
+
+//passes restart and stop signals to main server loop
+void handleServerSignal(int signalNumber){
+  int savedErrno = errno;
+  char signalByte = signalNumber;
+  //pipe is non-blocking, and if it is full the main loop has signals to handle anyway
+  write(signalPipeWriteFileDescriptor, &signalByte, 1);
+  errno = savedErrno;
+}
+
+//reaps connection processes as they exit, so they don't stay around as zombies
+void handleChildSignal(int signalNumber){
+  int savedErrno = errno;
+  while(waitpid(-1, NULL, WNOHANG) > 0){
+  }
+  errno = savedErrno;
+}
+
+//sets function to be called for signal, with interrupted system calls restarted
+void setSignalHandler(int signalNumber, void (*handler)(int)){
+  struct sigaction action;
+  bzero((char *) &action, sizeof(action));
+  action.sa_handler = handler;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+  sigaction(signalNumber, &action, NULL);
+}
+
+//creates pipe that isn't passed on to new programs
+//if isNonBlocking is 1, reading from an empty pipe or writing to a full one fails instead of waiting
+void createServerPipe(int pipeFileDescriptors[2], int isNonBlocking){
+  if(pipe(pipeFileDescriptors) < 0){
+    error("ERROR creating pipe");
+  }
+  int i;
+  for(i = 0; i < 2; ++i){
+    fcntl(pipeFileDescriptors[i], F_SETFD, FD_CLOEXEC);
+    if(isNonBlocking){
+      fcntl(pipeFileDescriptors[i], F_SETFL, O_NONBLOCK);
+    }
+  }
+}
+
+//returns milliseconds from an unspecified starting point, which only goes forward
+long getMilliseconds(void){
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000L + now.tv_nsec / 1000000;
+}
+
+//waits for a new server to write a byte to readyFileDescriptor, which it does once it is ready to accept connections
+//returns 1 if it did, or 0 if it exited or didn't get ready within RESTART_TIMEOUT_MILLISECONDS
+int waitForReplacementServer(int readyFileDescriptor){
+  long deadline = getMilliseconds() + RESTART_TIMEOUT_MILLISECONDS;
+  struct pollfd readyPollFileDescriptor = {readyFileDescriptor, POLLIN, 0};
+  while(1){
+    long remainingMilliseconds = deadline - getMilliseconds();
+    if(remainingMilliseconds <= 0){
+      return 0;
+    }
+    int pollResult = poll(&readyPollFileDescriptor, 1, remainingMilliseconds);
+    if(pollResult < 0 && errno == EINTR){
+      continue;
+    }
+    if(pollResult <= 0){
+      return 0;
+    }
+    //new server closing its end without writing means it exited before it was ready
+    char readyByte;
+    ssize_t charCountTransferred;
+    do{
+      charCountTransferred = read(readyFileDescriptor, &readyByte, 1);
+    }while(charCountTransferred < 0 && errno == EINTR);
+    return charCountTransferred == 1;
+  }
+}
+
+//starts a new server from the program file, which takes over the listening sockets
+//connections that arrive while the new server starts wait in the listening sockets' queue, so none are refused
+//new server is started from a second child process that exits straight away, so it isn't a child of this server
+//this server keeps accepting connections until the new server says it is ready, so a new server that fails to start
+//doesn't stop the service
+//returns 1 if new server is ready, or 0 if it isn't and this server should keep accepting connections
+int startReplacementServer(char **argv, struct pollfd *listeningSockets, int listeningSocketCount){
+  //new server writes a byte when it is ready, and its end is closed if it exits first
+  int readyPipe[2];
+  createServerPipe(readyPipe, 0);
+  int pid = fork();
+  if(pid < 0){
+    close(readyPipe[0]);
+    close(readyPipe[1]);
+    fprintf(stderr, "Could not start new server, so this server keeps accepting connections\n");
+    return 0;
+  }
+  if(pid == 0){
+    if(fork() != 0){
+      _exit(0);
+    }
+    //new server shouldn't be stopped by signals sent to this server's terminal or process group
+    setsid();
+    //move listening sockets to where the new server expects them, going through numbers above all of them
+    //so one socket isn't closed by moving another on top of it
+    int highestFileDescriptor = INHERITED_SOCKET_START + listeningSocketCount;
+    int i;
+    for(i = 0; i < listeningSocketCount; ++i){
+      listeningSockets[i].fd = fcntl(listeningSockets[i].fd, F_DUPFD, highestFileDescriptor);
+    }
+    //write end of ready pipe is the only other file descriptor kept open for the new server
+    int readyFileDescriptor = fcntl(readyPipe[1], F_DUPFD, highestFileDescriptor);
+    for(i = 0; i < listeningSocketCount; ++i){
+      dup2(listeningSockets[i].fd, INHERITED_SOCKET_START + i);
+      close(listeningSockets[i].fd);
+    }
+    char numberString[HEADER_BUFFER_SIZE];
+    snprintf(numberString, sizeof(numberString), "%d", listeningSocketCount);
+    setenv("LISTEN_FDS", numberString, 1);
+    snprintf(numberString, sizeof(numberString), "%ld", (long)getpid());
+    setenv("LISTEN_PID", numberString, 1);
+    snprintf(numberString, sizeof(numberString), "%d", readyFileDescriptor);
+    setenv(READY_FILE_DESCRIPTOR_VARIABLE, numberString, 1);
+    execvp(argv[0], argv);
+    fprintf(stderr, "Could not start new server from %s: %s\n", argv[0], strerror(errno));
+    _exit(1);
+  }
+
+  close(readyPipe[1]);
+  waitpid(pid, NULL, 0);
+  int isReady = waitForReplacementServer(readyPipe[0]);
+  //a new server that is still starting finds this closed when it tries to say it is ready, and exits
+  close(readyPipe[0]);
+  if(!isReady){
+    fprintf(stderr, "New server did not start, so this server keeps accepting connections\n");
+  }
+  return isReady;
+}
+
+//tells the server that started this one that it is ready to accept connections, so that server can stop accepting them
+//exits if the old server gave up waiting, since it is still using the listening sockets
+void notifyReplacedServer(void){
+  char *readyFileDescriptorString = getenv(READY_FILE_DESCRIPTOR_VARIABLE);
+  if(readyFileDescriptorString == NULL){
+    return;
+  }
+  int readyFileDescriptor = atoi(readyFileDescriptorString);
+  unsetenv(READY_FILE_DESCRIPTOR_VARIABLE);
+  char readyByte = 1;
+  //old server that gave up has closed its end, which is reported as an error instead of a signal
+  void (*previousHandler)(int) = signal(SIGPIPE, SIG_IGN);
+  ssize_t charCountTransferred;
+  do{
+    charCountTransferred = write(readyFileDescriptor, &readyByte, 1);
+  }while(charCountTransferred < 0 && errno == EINTR);
+  signal(SIGPIPE, previousHandler);
+  close(readyFileDescriptor);
+  if(charCountTransferred != 1){
+    fprintf(stderr, "Previous server stopped waiting for this one to start, so it is still accepting connections\n");
+    exit(1);
+  }
 }
 
 
@@ -402,54 +1123,124 @@ int main(int argc, char **argv){
   //get port number from command-line arguments
   //will print usage and exit if command-line arguments are invalid
   int portNum = validateCommandLineArguments(argc, argv);
+  loadTransformSettings();
 
   //do server setup and start server listing on portNum
-  int serverSocketFileDescriptor = initializeServer(portNum);
+  //and on unix domain socket if a path was given
+  //sockets passed by a previous server are already listening, so they are used as they are
+  int inheritedSocketCount = getInheritedSocketCount();
+  struct pollfd listeningSockets[3];
+  int listeningSocketCount = 0;
+  listeningSockets[listeningSocketCount].fd = inheritedSocketCount > listeningSocketCount ? INHERITED_SOCKET_START + listeningSocketCount : initializeServer(portNum);
+  listeningSocketCount++;
+  if(argc == 3){
+    listeningSockets[listeningSocketCount].fd = inheritedSocketCount > listeningSocketCount ? INHERITED_SOCKET_START + listeningSocketCount : initializeUnixServer(argv[2]);
+    listeningSocketCount++;
+  }
 
-  //we aren't using the following 2 variables, but we need them for the accept() function
-  //set aside memory for client connection address
-  struct sockaddr_in clientAddress;
-  //initialize address length, since it is used to accept connection
-  uint clientAddressLength = sizeof(clientAddress);
+  //restart and stop signals are read from a pipe along with the listening sockets
+  int signalPipe[2];
+  createServerPipe(signalPipe, 1);
+  signalPipeWriteFileDescriptor = signalPipe[1];
+  listeningSockets[listeningSocketCount].fd = signalPipe[0];
+  //connection processes close their connections when this pipe's write end is closed
+  int drainPipe[2];
+  createServerPipe(drainPipe, 0);
+  setSignalHandler(SIGHUP, handleServerSignal);
+  setSignalHandler(SIGTERM, handleServerSignal);
+  setSignalHandler(SIGCHLD, handleChildSignal);
+  //everything needed to accept connections is set up, so a server that started this one can stop accepting them
+  notifyReplacedServer();
+  //connection processes share the limit on xor memory, so it is created before any of them start
+  createXorMemorySemaphore();
 
-  //used to keep track of process after forking
-  int pid;
   //main server listen loop
-  while(1){
-    //accept connection
-    //don't need to close connection, because client should do this
-    int clientSocketFileDescriptor = accept(serverSocketFileDescriptor, (struct sockaddr *) &clientAddress, &clientAddressLength);
-    if(clientSocketFileDescriptor < 0){
-      error("ERROR while trying to accept connection");
+  int isAccepting = 1;
+  int i;
+  while(isAccepting){
+    //wait for a connection on any listening socket, or a signal
+    for(i = 0; i <= listeningSocketCount; ++i){
+      listeningSockets[i].events = POLLIN;
+      listeningSockets[i].revents = 0;
     }
-    //fork process, since only child process should handle connection
-    pid = fork();
-
-    //check for error with forking
-    if(pid < 0){
-      error("Could not create child process to handle connection");
+    if(poll(listeningSockets, listeningSocketCount + 1, -1) < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      error("ERROR while waiting for connection");
     }
-    //parent should just continue while loop, as it doesn't process connection
-    else if(pid > 0){
+
+    if(listeningSockets[listeningSocketCount].revents & POLLIN){
+      char signalByte;
+      while(isAccepting && read(signalPipe[0], &signalByte, 1) == 1){
+        //once a new server has the listening sockets, this one stops the same way as for SIGTERM
+        if(signalByte == SIGTERM || (signalByte == SIGHUP && startReplacementServer(argv, listeningSockets, listeningSocketCount))){
+          isAccepting = 0;
+        }
+      }
       continue;
     }
 
-    //only the child process should be here now
-    mainServerAction(clientSocketFileDescriptor);
-    //close client connection
-    close(clientSocketFileDescriptor);
-    //child exits loop after performing action
-    break;
-    
-  }
+    for(i = 0; i < listeningSocketCount; ++i){
+      if(!(listeningSockets[i].revents & POLLIN)){
+        continue;
+      }
+      //accept connection
+      //client address isn't used, so it isn't saved
+      int clientSocketFileDescriptor = accept(listeningSockets[i].fd, NULL, NULL);
+      if(clientSocketFileDescriptor < 0){
+        //client may have given up before connection was accepted
+        if(errno == EINTR || errno == ECONNABORTED){
+          continue;
+        }
+        error("ERROR while trying to accept connection");
+      }
+      //fork process, since only child process should handle connection
+      int pid = fork();
 
-  //we shouldn't ever reach here (in the parent process), as the only way to quit
-  //is to manually interrupt or kill process, but in case we do
-  //stop server listening if process is parent
-  if(pid > 0){
-    close(serverSocketFileDescriptor);
+      //check for error with forking
+      if(pid < 0){
+        error("Could not create child process to handle connection");
+      }
+      //parent doesn't process connection, so it only needs to close its copy of the socket
+      else if(pid > 0){
+        close(clientSocketFileDescriptor);
+        continue;
+      }
+
+      //only the child process should be here now
+      //child doesn't accept connections or handle server signals, so it doesn't need the listening sockets or pipes
+      int j;
+      for(j = 0; j < listeningSocketCount; ++j){
+        close(listeningSockets[j].fd);
+      }
+      close(signalPipe[0]);
+      close(signalPipe[1]);
+      close(drainPipe[1]);
+      signal(SIGHUP, SIG_DFL);
+      signal(SIGTERM, SIG_DFL);
+      signal(SIGCHLD, SIG_DFL);
+      mainServerAction(clientSocketFileDescriptor, drainPipe[0]);
+      //close client connection
+      close(clientSocketFileDescriptor);
+      //child exits after performing action
+      return 0;
+    }
   }
 
-  //for child process
+  //stop accepting connections, and tell connection processes to close their connections
+  //once the requests they are handling are finished
+  for(i = 0; i < listeningSocketCount; ++i){
+    close(listeningSockets[i].fd);
+  }
+  close(drainPipe[1]);
+  //wait for connection processes here instead of in the signal handler
+  signal(SIGCHLD, SIG_DFL);
+  while(waitpid(-1, NULL, 0) > 0 || errno == EINTR){
+  }
+  //semaphores last until they are removed, even after every process using them exits
+  if(xorMemorySemaphore >= 0){
+    semctl(xorMemorySemaphore, 0, IPC_RMID);
+  }
   return 0;
-}
\ No newline at end of file
+}
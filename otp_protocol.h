@@ -0,0 +1,77 @@
+/*
+ * Constants of the protocol between clients and servers
+ * shared by the servers, the command-line clients, the client library and checks, so they can't get out of step
+ * every request starts with a header line saying what kind of request it is, and errors are sent as lines starting with '@'
+ */
+
+#ifndef OTP_PROTOCOL_H
+#define OTP_PROTOCOL_H
+
+//maximum number of characters in a text key or message, including its terminator and a null char
+#ifndef MESSAGE_BUFFER_SIZE
+#define MESSAGE_BUFFER_SIZE 131071
+#endif
+
+//maximum number of characters in a header or other line that isn't data, including null char
+#define HEADER_BUFFER_SIZE 64
+
+//character used to terminate headers, lines, and text keys and messages
+#define DATA_TERMINATING_CHAR '\n'
+
+//sent by server when it is ready for the next part of a request
+#define OK_MESSAGE "@OK\n"
+
+//character that starts error messages from server
+//valid text results never contain it, so results and errors can be told apart
+#define SERVER_ERROR_CHAR '@'
+
+//names of the two kinds of text requests, which are only accepted by encoding and decoding servers respectively
+//a header for a text request is the name followed by a terminator, and other headers add a suffix to the name
+#define ENCODE_REQUEST_NAME "ENCODE"
+#define DECODE_REQUEST_NAME "DECODE"
+#define ENCODE_MESSAGE_HEADER ENCODE_REQUEST_NAME "\n"
+#define DECODE_MESSAGE_HEADER DECODE_REQUEST_NAME "\n"
+
+//start of header for byte xor mode, followed by number of bytes
+//xor mode accepts any bytes, so key and message are not terminated or validated
+//and both encoding and decoding servers accept it, since xor is its own inverse
+#define XOR_MESSAGE_HEADER_PREFIX "XOR "
+
+//maximum number of bytes in one xor request
+//length is declared up front, so buffers are allocated to fit instead of being limited to MESSAGE_BUFFER_SIZE
+#ifndef MAX_XOR_MESSAGE_SIZE
+#define MAX_XOR_MESSAGE_SIZE 268435456L
+#endif
+
+//added to a request name for stream mode
+//in stream mode, key and message are sent in chunks, each starting with its length on its own line
+//and a chunk length of 0 ends the stream
+#define STREAM_MESSAGE_HEADER_SUFFIX " STREAM\n"
+
+//maximum number of characters in one chunk in stream mode
+#define STREAM_CHUNK_SIZE 65536
+
+//added to a request name for compressed stream mode
+//the same as stream mode, except each chunk's length line is followed by the length of the message data sent for it,
+//and each result is sent after a line with the length of its data, with a final chunk line of "0 0"
+//data shorter than the chunk is compressed with otpCompress, otherwise it is sent as it is
+//only plaintext is worth compressing, since ciphertext and keys are random, so decoding servers compress results
+//and encoding clients compress messages
+#define COMPRESSED_STREAM_MESSAGE_HEADER_SUFFIX " STREAM COMPRESSED\n"
+
+//added to a request name for shared memory mode, followed by size of shared memory in bytes
+//in shared memory mode, client sends file descriptor of shared memory over unix domain socket
+//then each request is a line with offsets of message and key in shared memory and their length,
+//and message is transformed in place, so it doesn't have to be copied through the socket
+#define SHARED_MEMORY_MESSAGE_HEADER_SUFFIX " SHM "
+
+//added to a request name for batch mode, followed by number of requests in batch
+//in batch mode, client sends key and message lines for every request without waiting for ok messages,
+//and all results are sent back together as one line each, so many short messages need only one round trip
+#define BATCH_MESSAGE_HEADER_SUFFIX " BATCH "
+
+//largest number of requests in one batch
+//keys and messages of all requests together must fit in MESSAGE_BUFFER_SIZE
+#define MAX_BATCH_REQUEST_COUNT 4096
+
+#endif
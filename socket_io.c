@@ -0,0 +1,321 @@
+/*
+ * Buffered socket reading/writing shared by clients and servers
+ */
+
+//for memfd_create
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <unistd.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <limits.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "socket_io.h"
+
+//sets up connection to use socket identified by file descriptor with an empty read buffer
+void initializeBufferedConnection(BufferedConnection *connection, int fileDescriptor){
+  connection->fileDescriptor = fileDescriptor;
+  connection->readPosition = 0;
+  connection->readFill = 0;
+}
+
+//writes all of the data in vectors to socket
+//vectors are modified as data is written, so partial writes continue where they left off
+//returns 0 on success or SOCKET_IO_ERROR
+int writeVectorsToSocket(int fileDescriptor, struct iovec *vectors, int vectorCount){
+  while(vectorCount > 0){
+    //writev only takes a limited number of vectors at a time
+    ssize_t charCountTransferred = writev(fileDescriptor, vectors, vectorCount < IOV_MAX ? vectorCount : IOV_MAX);
+    if(charCountTransferred < 0){
+      //interrupted by signal before anything was written, so just try again
+      if(errno == EINTR){
+        continue;
+      }
+      return SOCKET_IO_ERROR;
+    }
+    //skip vectors that were written completely
+    while(vectorCount > 0 && (size_t)charCountTransferred >= vectors->iov_len){
+      charCountTransferred -= vectors->iov_len;
+      vectors++;
+      vectorCount--;
+    }
+    //move start of partially written vector past data already sent
+    if(vectorCount > 0){
+      vectors->iov_base = (char *)vectors->iov_base + charCountTransferred;
+      vectors->iov_len -= charCountTransferred;
+    }
+  }
+  return 0;
+}
+
+//writes length bytes of data to socket, looping until all of it is written
+//returns 0 on success or SOCKET_IO_ERROR
+int writeAllToSocket(int fileDescriptor, const char *data, size_t length){
+  struct iovec vector = {(void *)data, length};
+  return writeVectorsToSocket(fileDescriptor, &vector, 1);
+}
+
+//writes length bytes of data followed by terminator character in a single system call when possible
+//returns 0 on success or SOCKET_IO_ERROR
+int writeToSocketWithTerminator(int fileDescriptor, const char *data, size_t length, char terminator){
+  struct iovec vectors[2] = {
+    {(void *)data, length},
+    {&terminator, 1}
+  };
+  return writeVectorsToSocket(fileDescriptor, vectors, 2);
+}
+
+//reads from socket into the connection's read buffer, after moving any unused data to the front
+//returns number of bytes read, 0 if other side closed the connection, or SOCKET_IO_ERROR
+static ssize_t fillReadBuffer(BufferedConnection *connection){
+  //only data between readPosition and readFill is still needed, so move it to the front
+  if(connection->readPosition > 0){
+    size_t unusedLength = connection->readFill - connection->readPosition;
+    memmove(connection->readBuffer, connection->readBuffer + connection->readPosition, unusedLength);
+    connection->readPosition = 0;
+    connection->readFill = unusedLength;
+  }
+  ssize_t charCountTransferred;
+  do{
+    charCountTransferred = read(connection->fileDescriptor, connection->readBuffer + connection->readFill, SOCKET_READ_BUFFER_SIZE - connection->readFill);
+  }while(charCountTransferred < 0 && errno == EINTR);
+
+  if(charCountTransferred < 0){
+    return SOCKET_IO_ERROR;
+  }
+  connection->readFill += charCountTransferred;
+  return charCountTransferred;
+}
+
+//reads from connection into destination until terminator character is found
+//terminator is stored in destination, followed by a null char
+//returns number of bytes stored in destination, including terminator
+//or SOCKET_IO_ERROR, SOCKET_IO_CLOSED or SOCKET_IO_OVERFLOW
+ssize_t readFromSocketUntilTerminator(BufferedConnection *connection, char *destination, size_t destinationSize, char terminator){
+  size_t destinationFill = 0;
+  while(1){
+    //only search data that hasn't been searched yet
+    char *unusedData = connection->readBuffer + connection->readPosition;
+    size_t unusedLength = connection->readFill - connection->readPosition;
+    char *terminatorPointer = memchr(unusedData, terminator, unusedLength);
+    //copy up to and including terminator if found, or all of the unused data if not
+    size_t copyLength = terminatorPointer != NULL ? (size_t)(terminatorPointer - unusedData) + 1 : unusedLength;
+    //leave room for null char
+    //fill destination before reporting overflow, so caller can continue reading into a bigger buffer
+    if(destinationFill + copyLength + 1 > destinationSize){
+      copyLength = destinationSize - 1 - destinationFill;
+      memcpy(destination + destinationFill, unusedData, copyLength);
+      connection->readPosition += copyLength;
+      destination[destinationSize - 1] = '\0';
+      return SOCKET_IO_OVERFLOW;
+    }
+    memcpy(destination + destinationFill, unusedData, copyLength);
+    destinationFill += copyLength;
+    connection->readPosition += copyLength;
+
+    if(terminatorPointer != NULL){
+      destination[destinationFill] = '\0';
+      return destinationFill;
+    }
+    //everything buffered has been used, so get more from socket
+    ssize_t charCountTransferred = fillReadBuffer(connection);
+    if(charCountTransferred < 0){
+      return SOCKET_IO_ERROR;
+    }
+    if(charCountTransferred == 0){
+      return SOCKET_IO_CLOSED;
+    }
+  }
+}
+
+//reads exactly length bytes from connection into destination
+//data already in the read buffer is used first, and the rest is read directly into destination
+//returns length or SOCKET_IO_ERROR or SOCKET_IO_CLOSED
+ssize_t readFromSocketExactly(BufferedConnection *connection, char *destination, size_t length){
+  //use data that was already read ahead
+  size_t unusedLength = connection->readFill - connection->readPosition;
+  size_t destinationFill = unusedLength < length ? unusedLength : length;
+  memcpy(destination, connection->readBuffer + connection->readPosition, destinationFill);
+  connection->readPosition += destinationFill;
+
+  //rest of the data doesn't need to be searched, so skip the read buffer
+  while(destinationFill < length){
+    ssize_t charCountTransferred = read(connection->fileDescriptor, destination + destinationFill, length - destinationFill);
+    if(charCountTransferred < 0){
+      if(errno == EINTR){
+        continue;
+      }
+      return SOCKET_IO_ERROR;
+    }
+    if(charCountTransferred == 0){
+      return SOCKET_IO_CLOSED;
+    }
+    destinationFill += charCountTransferred;
+  }
+  return length;
+}
+
+//sends file descriptor to other side of unix domain socket, along with a single byte of data
+//returns 0 on success or SOCKET_IO_ERROR
+int sendFileDescriptor(int socketFileDescriptor, int fileDescriptorToSend){
+  //file descriptors can only be sent with at least one byte of data
+  char data = 'F';
+  struct iovec vector = {&data, 1};
+  //control message buffer, aligned as required for cmsghdr
+  union{
+    char buffer[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+  memset(&control, 0, sizeof(control));
+
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &vector;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = sizeof(control.buffer);
+  struct cmsghdr *controlMessage = CMSG_FIRSTHDR(&message);
+  controlMessage->cmsg_level = SOL_SOCKET;
+  controlMessage->cmsg_type = SCM_RIGHTS;
+  controlMessage->cmsg_len = CMSG_LEN(sizeof(int));
+  memcpy(CMSG_DATA(controlMessage), &fileDescriptorToSend, sizeof(int));
+
+  ssize_t charCountTransferred;
+  do{
+    charCountTransferred = sendmsg(socketFileDescriptor, &message, 0);
+  }while(charCountTransferred < 0 && errno == EINTR);
+  return charCountTransferred == 1 ? 0 : SOCKET_IO_ERROR;
+}
+
+//receives file descriptor sent with sendFileDescriptor from unix domain socket
+//returns received file descriptor, or SOCKET_IO_ERROR or SOCKET_IO_CLOSED
+int receiveFileDescriptor(BufferedConnection *connection){
+  if(connection->readPosition != connection->readFill){
+    return SOCKET_IO_ERROR;
+  }
+  char data;
+  struct iovec vector = {&data, 1};
+  union{
+    char buffer[CMSG_SPACE(sizeof(int))];
+    struct cmsghdr align;
+  } control;
+
+  struct msghdr message;
+  memset(&message, 0, sizeof(message));
+  message.msg_iov = &vector;
+  message.msg_iovlen = 1;
+  message.msg_control = control.buffer;
+  message.msg_controllen = sizeof(control.buffer);
+
+  ssize_t charCountTransferred;
+  do{
+    charCountTransferred = recvmsg(connection->fileDescriptor, &message, 0);
+  }while(charCountTransferred < 0 && errno == EINTR);
+  if(charCountTransferred < 0){
+    return SOCKET_IO_ERROR;
+  }
+  //every file descriptor received is now open in this process, so any that aren't returned are closed
+  int receivedFileDescriptor = -1;
+  int receivedCount = 0;
+  struct cmsghdr *controlMessage;
+  for(controlMessage = CMSG_FIRSTHDR(&message); controlMessage != NULL; controlMessage = CMSG_NXTHDR(&message, controlMessage)){
+    if(controlMessage->cmsg_level != SOL_SOCKET || controlMessage->cmsg_type != SCM_RIGHTS){
+      continue;
+    }
+    size_t count = (controlMessage->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    size_t i;
+    for(i = 0; i < count; ++i){
+      int fileDescriptor;
+      memcpy(&fileDescriptor, CMSG_DATA(controlMessage) + i * sizeof(int), sizeof(int));
+      if(receivedCount++ == 0){
+        receivedFileDescriptor = fileDescriptor;
+      }
+      else{
+        close(fileDescriptor);
+      }
+    }
+  }
+  if(charCountTransferred == 0 || receivedCount != 1 || (message.msg_flags & MSG_CTRUNC)){
+    if(receivedFileDescriptor >= 0){
+      close(receivedFileDescriptor);
+    }
+    return charCountTransferred == 0 ? SOCKET_IO_CLOSED : SOCKET_IO_ERROR;
+  }
+  return receivedFileDescriptor;
+}
+
+//creates anonymous shared memory of size bytes that can be sent to another process with sendFileDescriptor
+//on linux it is sealed so it can't be made smaller, since the other process would crash accessing memory past the end
+//returns file descriptor, or -1 on failure
+int createSharedMemory(size_t size){
+#ifdef __linux__
+  int fileDescriptor = memfd_create("otp", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+  //shared memory object is unlinked right away, so only the file descriptor refers to it
+  char name[64];
+  snprintf(name, sizeof(name), "/otp-%ld", (long)getpid());
+  int fileDescriptor = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if(fileDescriptor >= 0){
+    shm_unlink(name);
+  }
+#endif
+  if(fileDescriptor < 0){
+    return -1;
+  }
+  if(ftruncate(fileDescriptor, size) < 0){
+    close(fileDescriptor);
+    return -1;
+  }
+#ifdef __linux__
+  if(fcntl(fileDescriptor, F_ADD_SEALS, F_SEAL_SHRINK) < 0){
+    close(fileDescriptor);
+    return -1;
+  }
+#endif
+  return fileDescriptor;
+}
+
+//checks shared memory received from another process is at least size bytes, and can't be made smaller
+//on linux, shared memory must be sealed by createSharedMemory, and elsewhere only its current size is checked
+//returns 1 if it is safe to map size bytes, otherwise 0
+int isSharedMemoryUsable(int fileDescriptor, size_t size){
+#ifdef __linux__
+  int seals = fcntl(fileDescriptor, F_GET_SEALS);
+  if(seals < 0 || !(seals & F_SEAL_SHRINK)){
+    return 0;
+  }
+#endif
+  struct stat status;
+  return fstat(fileDescriptor, &status) == 0 && status.st_size >= 0 && (size_t)status.st_size >= size;
+}
+
+//turns Nagle's algorithm off (enabled is 1) or on (enabled is 0) for tcp socket
+//returns 0 on success, -1 on failure
+int setSocketNoDelay(int fileDescriptor, int enabled){
+  return setsockopt(fileDescriptor, IPPROTO_TCP, TCP_NODELAY, (const void *)&enabled, sizeof(int));
+}
+
+//makes socket's receive buffer hold at least size bytes, so the other side can send that much before it is read
+//returns 0 on success, -1 on failure
+int reserveSocketReceiveBuffer(int fileDescriptor, int size){
+  int currentSize;
+  socklen_t optionLength = sizeof(currentSize);
+  if(getsockopt(fileDescriptor, SOL_SOCKET, SO_RCVBUF, (void *)&currentSize, &optionLength) < 0){
+    return -1;
+  }
+  if(currentSize >= size){
+    return 0;
+  }
+  return setsockopt(fileDescriptor, SOL_SOCKET, SO_RCVBUF, (const void *)&size, sizeof(int));
+}
@@ -0,0 +1,93 @@
+/*
+ * Buffered socket reading/writing shared by clients and servers
+ * reads are done through a read-ahead buffer that keeps track of its own fill level,
+ * and writes loop until all data is sent, so messages are never truncated
+ */
+
+#ifndef SOCKET_IO_H
+#define SOCKET_IO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+//number of bytes that can be read from a socket ahead of what has been consumed
+#define SOCKET_READ_BUFFER_SIZE 16384
+
+//return values for socket reading/writing functions
+//socket read or write failed
+#define SOCKET_IO_ERROR -1
+//other side closed connection before data was complete
+#define SOCKET_IO_CLOSED -2
+//data did not fit in the destination buffer
+#define SOCKET_IO_OVERFLOW -3
+
+//socket connection with buffer for data that has been read
+//from the socket, but not yet used
+typedef struct BufferedConnection{
+  int fileDescriptor;
+  //data read from socket
+  char readBuffer[SOCKET_READ_BUFFER_SIZE];
+  //index of first byte in readBuffer that hasn't been used yet
+  size_t readPosition;
+  //number of bytes in readBuffer that contain data
+  size_t readFill;
+} BufferedConnection;
+
+//sets up connection to use socket identified by file descriptor with an empty read buffer
+void initializeBufferedConnection(BufferedConnection *connection, int fileDescriptor);
+
+//writes all of the data in vectors to socket in as few system calls as possible
+//vectors are modified as data is written
+//returns 0 on success or SOCKET_IO_ERROR
+int writeVectorsToSocket(int fileDescriptor, struct iovec *vectors, int vectorCount);
+
+//writes length bytes of data to socket, looping until all of it is written
+//returns 0 on success or SOCKET_IO_ERROR
+int writeAllToSocket(int fileDescriptor, const char *data, size_t length);
+
+//writes length bytes of data followed by terminator character in a single system call when possible
+//returns 0 on success or SOCKET_IO_ERROR
+int writeToSocketWithTerminator(int fileDescriptor, const char *data, size_t length, char terminator);
+
+//reads from connection into destination until terminator character is found
+//terminator is stored in destination, followed by a null char
+//returns number of bytes stored in destination, including terminator
+//or SOCKET_IO_ERROR, SOCKET_IO_CLOSED or SOCKET_IO_OVERFLOW
+//on SOCKET_IO_OVERFLOW, destinationSize - 1 bytes have been stored, and the rest can be read by calling again
+ssize_t readFromSocketUntilTerminator(BufferedConnection *connection, char *destination, size_t destinationSize, char terminator);
+
+//reads exactly length bytes from connection into destination
+//data already in the read buffer is used first, and the rest is read directly into destination
+//returns length or SOCKET_IO_ERROR or SOCKET_IO_CLOSED
+ssize_t readFromSocketExactly(BufferedConnection *connection, char *destination, size_t length);
+
+//sends file descriptor to other side of unix domain socket, along with a single byte of data
+//returns 0 on success or SOCKET_IO_ERROR
+int sendFileDescriptor(int socketFileDescriptor, int fileDescriptorToSend);
+
+//receives file descriptor sent with sendFileDescriptor from unix domain socket
+//read buffer must be empty, since file descriptors are lost if the data they came with is read ahead
+//returns received file descriptor, or SOCKET_IO_ERROR or SOCKET_IO_CLOSED
+int receiveFileDescriptor(BufferedConnection *connection);
+
+//creates anonymous shared memory of size bytes that can be sent to another process with sendFileDescriptor
+//on linux it is sealed so it can't be made smaller, since the other process would crash accessing memory past the end
+//returns file descriptor, or -1 on failure
+int createSharedMemory(size_t size);
+
+//checks shared memory received from another process is at least size bytes, and can't be made smaller
+//on linux, shared memory must be sealed by createSharedMemory, and elsewhere only its current size is checked
+//returns 1 if it is safe to map size bytes, otherwise 0
+int isSharedMemoryUsable(int fileDescriptor, size_t size);
+
+//turns Nagle's algorithm off (enabled is 1) or on (enabled is 0) for tcp socket
+//returns 0 on success, -1 on failure
+int setSocketNoDelay(int fileDescriptor, int enabled);
+
+//makes socket's receive buffer hold at least size bytes, so the other side can send that much before it is read
+//buffer is never made smaller, since the system may have already made it bigger
+//returns 0 on success, -1 on failure
+int reserveSocketReceiveBuffer(int fileDescriptor, int size);
+
+#endif
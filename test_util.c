@@ -0,0 +1,105 @@
+/*
+ * Helpers shared by otp_bench and otp_check for running local servers
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "test_util.h"
+
+//listening sockets passed to server are numbered from here, the same as the sockets systemd passes
+#define INHERITED_SOCKET_START 3
+
+//starts server at serverPath on a port chosen by the operating system
+//listening socket is passed to the server the same way as when it restarts, so it is ready before the server starts
+//returns process id of server, and stores its port in port
+int startServer(const char *serverPath, int *port){
+	return startServerWithUnixSocket(serverPath, port, NULL, 0);
+}
+
+//starts server the same way as startServer, and also listening on a unix domain socket at unixSocketPath if it isn't NULL
+//which queues up to queueSize connections that haven't been accepted
+int startServerWithUnixSocket(const char *serverPath, int *port, const char *unixSocketPath, int queueSize){
+	int listeningSocketFileDescriptors[2];
+	int listeningSocketCount = 0;
+	int listeningSocketFileDescriptor = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in serverAddress;
+	memset(&serverAddress, 0, sizeof(serverAddress));
+	serverAddress.sin_family = AF_INET;
+	serverAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t serverAddressLength = sizeof(serverAddress);
+	if(listeningSocketFileDescriptor < 0 || bind(listeningSocketFileDescriptor, (struct sockaddr *) &serverAddress, sizeof(serverAddress)) < 0 ||
+		listen(listeningSocketFileDescriptor, SOMAXCONN) < 0 || getsockname(listeningSocketFileDescriptor, (struct sockaddr *) &serverAddress, &serverAddressLength) < 0){
+		perror("Could not create listening socket for server");
+		exit(1);
+	}
+	*port = ntohs(serverAddress.sin_port);
+	listeningSocketFileDescriptors[listeningSocketCount++] = listeningSocketFileDescriptor;
+
+	if(unixSocketPath != NULL){
+		struct sockaddr_un unixAddress;
+		memset(&unixAddress, 0, sizeof(unixAddress));
+		unixAddress.sun_family = AF_UNIX;
+		strncpy(unixAddress.sun_path, unixSocketPath, sizeof(unixAddress.sun_path) - 1);
+		listeningSocketFileDescriptor = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(listeningSocketFileDescriptor < 0 || bind(listeningSocketFileDescriptor, (struct sockaddr *) &unixAddress, sizeof(unixAddress)) < 0 ||
+			listen(listeningSocketFileDescriptor, queueSize) < 0){
+			perror("Could not create unix domain socket for server");
+			exit(1);
+		}
+		listeningSocketFileDescriptors[listeningSocketCount++] = listeningSocketFileDescriptor;
+	}
+
+	int pid = fork();
+	if(pid < 0){
+		perror("Could not start server");
+		exit(1);
+	}
+	if(pid == 0){
+		char portString[16];
+		char socketCountString[16];
+		char processIdString[16];
+		snprintf(portString, sizeof(portString), "%d", *port);
+		snprintf(socketCountString, sizeof(socketCountString), "%d", listeningSocketCount);
+		snprintf(processIdString, sizeof(processIdString), "%ld", (long)getpid());
+		//sockets are moved to numbers after the highest one they will get, so moving one doesn't replace another
+		int i;
+		for(i = 0; i < listeningSocketCount; ++i){
+			int movedFileDescriptor = fcntl(listeningSocketFileDescriptors[i], F_DUPFD, INHERITED_SOCKET_START + listeningSocketCount);
+			close(listeningSocketFileDescriptors[i]);
+			listeningSocketFileDescriptors[i] = movedFileDescriptor;
+		}
+		for(i = 0; i < listeningSocketCount; ++i){
+			dup2(listeningSocketFileDescriptors[i], INHERITED_SOCKET_START + i);
+			close(listeningSocketFileDescriptors[i]);
+		}
+		setenv("LISTEN_FDS", socketCountString, 1);
+		setenv("LISTEN_PID", processIdString, 1);
+		//without a unix domain socket, its NULL path ends the arguments after the port
+		execl(serverPath, serverPath, portString, unixSocketPath, (char *)NULL);
+		perror(serverPath);
+		_exit(1);
+	}
+	int i;
+	for(i = 0; i < listeningSocketCount; ++i){
+		close(listeningSocketFileDescriptors[i]);
+	}
+	return pid;
+}
+
+//stops server started by startServer
+//SIGTERM makes it stop accepting connections and exit once the ones it has are finished
+void stopServer(int serverProcessId){
+	kill(serverProcessId, SIGTERM);
+	waitpid(serverProcessId, NULL, 0);
+}
@@ -0,0 +1,21 @@
+/*
+ * Helpers shared by otp_bench and otp_check for running local servers
+ */
+
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+//starts server at serverPath on a port of this computer chosen by the operating system
+//listening socket is passed to the server the same way as when it restarts, so it is ready before the server starts
+//returns process id of server, and stores its port in port
+//exits if server can't be started
+int startServer(const char *serverPath, int *port);
+
+//starts server the same way as startServer, and also listening on a unix domain socket at unixSocketPath if it isn't NULL
+//which queues up to queueSize connections that haven't been accepted
+int startServerWithUnixSocket(const char *serverPath, int *port, const char *unixSocketPath, int queueSize);
+
+//stops server started by startServer, once it has finished its connections
+void stopServer(int serverProcessId);
+
+#endif